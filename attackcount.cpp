@@ -0,0 +1,181 @@
+#include "attackcount.h"
+
+#include <assert.h>
+
+#if SIMD_X86 == 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+namespace chesseng {
+namespace {
+typedef AttackCountSummary (*AttackCountKernel)(const int8_t* white, const int8_t* black);
+
+AttackCountSummary summarizeScalar(const int8_t* white, const int8_t* black) {
+  AttackCountSummary summary;
+  for(uint8_t posIndex=0;posIndex<64;posIndex++) {
+    Bitboard posBB = squareBB(posIndex);
+    summary.whiteAttacked |= white[posIndex] != 0 ? posBB : 0;
+    summary.blackAttacked |= black[posIndex] != 0 ? posBB : 0;
+    summary.whiteMore |= white[posIndex] > black[posIndex] ? posBB : 0;
+    summary.blackMore |= black[posIndex] > white[posIndex] ? posBB : 0;
+    summary.whiteTotal += white[posIndex];
+    summary.blackTotal += black[posIndex];
+  }
+  return summary;
+}
+
+#if SIMD_X86 == 1
+// 16 squares per step, SSE2 is part of x86-64
+SIMD_TARGET("sse2")
+AttackCountSummary summarizeSse2(const int8_t* white, const int8_t* black) {
+  AttackCountSummary summary;
+  __m128i zero = _mm_setzero_si128();
+  __m128i whiteSum = zero;
+  __m128i blackSum = zero;
+  for(uint8_t offset=0;offset<64;offset+=16) {
+    __m128i w = _mm_loadu_si128(reinterpret_cast<const __m128i*>(white + offset));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(black + offset));
+    summary.whiteAttacked |= static_cast<Bitboard>(~_mm_movemask_epi8(_mm_cmpeq_epi8(w, zero)) & 0xffff) << offset;
+    summary.blackAttacked |= static_cast<Bitboard>(~_mm_movemask_epi8(_mm_cmpeq_epi8(b, zero)) & 0xffff) << offset;
+    summary.whiteMore |= static_cast<Bitboard>(_mm_movemask_epi8(_mm_cmpgt_epi8(w, b))) << offset;
+    summary.blackMore |= static_cast<Bitboard>(_mm_movemask_epi8(_mm_cmpgt_epi8(b, w))) << offset;
+    // counts are not negative, so unsigned byte sums are exact
+    whiteSum = _mm_add_epi64(whiteSum, _mm_sad_epu8(w, zero));
+    blackSum = _mm_add_epi64(blackSum, _mm_sad_epu8(b, zero));
+  }
+  summary.whiteTotal = _mm_cvtsi128_si32(whiteSum) + _mm_extract_epi16(whiteSum, 4);
+  summary.blackTotal = _mm_cvtsi128_si32(blackSum) + _mm_extract_epi16(blackSum, 4);
+  return summary;
+}
+
+// 32 squares per step
+SIMD_TARGET("avx2")
+AttackCountSummary summarizeAvx2(const int8_t* white, const int8_t* black) {
+  AttackCountSummary summary;
+  __m256i zero = _mm256_setzero_si256();
+  __m256i whiteSum = zero;
+  __m256i blackSum = zero;
+  for(uint8_t offset=0;offset<64;offset+=32) {
+    __m256i w = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(white + offset));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(black + offset));
+    summary.whiteAttacked |= static_cast<Bitboard>(~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(w, zero)))) << offset;
+    summary.blackAttacked |= static_cast<Bitboard>(~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, zero)))) << offset;
+    summary.whiteMore |= static_cast<Bitboard>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpgt_epi8(w, b)))) << offset;
+    summary.blackMore |= static_cast<Bitboard>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpgt_epi8(b, w)))) << offset;
+    whiteSum = _mm256_add_epi64(whiteSum, _mm256_sad_epu8(w, zero));
+    blackSum = _mm256_add_epi64(blackSum, _mm256_sad_epu8(b, zero));
+  }
+  __m128i whiteHalves = _mm_add_epi64(_mm256_castsi256_si128(whiteSum), _mm256_extracti128_si256(whiteSum, 1));
+  __m128i blackHalves = _mm_add_epi64(_mm256_castsi256_si128(blackSum), _mm256_extracti128_si256(blackSum, 1));
+  summary.whiteTotal = _mm_cvtsi128_si32(whiteHalves) + _mm_extract_epi16(whiteHalves, 4);
+  summary.blackTotal = _mm_cvtsi128_si32(blackHalves) + _mm_extract_epi16(blackHalves, 4);
+  return summary;
+}
+
+// all 64 squares at once, comparisons produce bitboards directly
+SIMD_TARGET("avx512f,avx512bw")
+AttackCountSummary summarizeAvx512(const int8_t* white, const int8_t* black) {
+  AttackCountSummary summary;
+  __m512i zero = _mm512_setzero_si512();
+  __m512i w = _mm512_loadu_si512(white);
+  __m512i b = _mm512_loadu_si512(black);
+  summary.whiteAttacked = _mm512_cmpneq_epi8_mask(w, zero);
+  summary.blackAttacked = _mm512_cmpneq_epi8_mask(b, zero);
+  summary.whiteMore = _mm512_cmpgt_epi8_mask(w, b);
+  summary.blackMore = _mm512_cmpgt_epi8_mask(b, w);
+  // one 64-bit lane per 8 squares
+  std::array<uint64_t, 8> whiteSums;
+  std::array<uint64_t, 8> blackSums;
+  _mm512_storeu_si512(whiteSums.data(), _mm512_sad_epu8(w, zero));
+  _mm512_storeu_si512(blackSums.data(), _mm512_sad_epu8(b, zero));
+  for(uint8_t lane=0;lane<8;lane++) {
+    summary.whiteTotal += whiteSums[lane];
+    summary.blackTotal += blackSums[lane];
+  }
+  return summary;
+}
+#endif
+
+SimdLevel detectSimdLevel() {
+  #if SIMD_X86 == 1 && defined(_MSC_VER)
+  // the cpu has the instructions and the OS saves the registers of them
+  int info[4];
+  __cpuid(info, 1);
+  bool osSavesAvx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+  bool osSavesAvx512 = osSavesAvx && (_xgetbv(0) & 0xe6) == 0xe6;
+  __cpuid(info, 0);
+  if(!osSavesAvx || info[0] < 7) {
+    return SimdLevel::SSE2;
+  }
+  __cpuidex(info, 7, 0);
+  if(osSavesAvx512 && (info[1] & (1 << 16)) != 0 && (info[1] & (1 << 30)) != 0) {
+    return SimdLevel::AVX512;
+  }
+  if((info[1] & (1 << 5)) != 0) {
+    return SimdLevel::AVX2;
+  }
+  return SimdLevel::SSE2;
+  #elif SIMD_X86 == 1
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx512bw")) {
+    return SimdLevel::AVX512;
+  }
+  if(__builtin_cpu_supports("avx2")) {
+    return SimdLevel::AVX2;
+  }
+  return SimdLevel::SSE2;
+  #else
+  return SimdLevel::SCALAR;
+  #endif
+}
+
+AttackCountKernel getKernel(SimdLevel level) {
+  switch(level) {
+    #if SIMD_X86 == 1
+    case SimdLevel::AVX512:
+      return summarizeAvx512;
+    case SimdLevel::AVX2:
+      return summarizeAvx2;
+    case SimdLevel::SSE2:
+      return summarizeSse2;
+    #endif
+    default:
+      return summarizeScalar;
+  }
+}
+
+const AttackCountKernel ATTACK_COUNT_KERNEL = getKernel(getSimdLevel());
+}
+
+// function local, kernels of other translation units are picked during static initialization too
+SimdLevel getSimdLevel() {
+  static const SimdLevel level = detectSimdLevel();
+  return level;
+}
+
+const char* getSimdLevelName(SimdLevel level) {
+  switch(level) {
+    case SimdLevel::SSE2:
+      return "SSE2";
+    case SimdLevel::AVX2:
+      return "AVX2";
+    case SimdLevel::AVX512:
+      return "AVX-512";
+    default:
+      return "scalar";
+  }
+}
+
+AttackCountSummary summarizeAttackCounts(const std::array<int8_t,64>& white, const std::array<int8_t,64>& black, SimdLevel level) {
+  assert(level <= getSimdLevel());
+  return getKernel(level)(white.data(), black.data());
+}
+
+AttackCountSummary summarizeAttackCounts(const std::array<int8_t,64>& white, const std::array<int8_t,64>& black) {
+  return ATTACK_COUNT_KERNEL(white.data(), black.data());
+}
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "bitboard.h"
+
+// x86 kernels are built one function at a time for their instruction set and picked at runtime;
+// cl.exe allows any intrinsic in any function and has no target attribute
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define SIMD_X86 1
+#else
+#define SIMD_X86 0
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define SIMD_TARGET(features)
+#else
+#define SIMD_TARGET(features) __attribute__((target(features)))
+#endif
+
+namespace chesseng {
+
+// instruction sets for the attack count kernel, the best supported one is picked at startup
+enum class SimdLevel: uint8_t {
+  SCALAR=0,
+  SSE2=1,
+  AVX2=2,
+  AVX512=3
+};
+
+// per square comparison of the white and black attack counts
+struct AttackCountSummary {
+  Bitboard whiteAttacked{0};
+  Bitboard blackAttacked{0};
+  // more white than black attackers
+  Bitboard whiteMore{0};
+  // more black than white attackers
+  Bitboard blackMore{0};
+  // sum of the counts over all squares
+  int16_t whiteTotal{0};
+  int16_t blackTotal{0};
+};
+
+inline bool operator==(const AttackCountSummary& lhs, const AttackCountSummary& rhs) {
+  return lhs.whiteAttacked == rhs.whiteAttacked && lhs.blackAttacked == rhs.blackAttacked
+    && lhs.whiteMore == rhs.whiteMore && lhs.blackMore == rhs.blackMore
+    && lhs.whiteTotal == rhs.whiteTotal && lhs.blackTotal == rhs.blackTotal;
+}
+
+SimdLevel getSimdLevel();
+const char* getSimdLevelName(SimdLevel level);
+
+// counts must not be negative, level must not exceed getSimdLevel()
+AttackCountSummary summarizeAttackCounts(const std::array<int8_t,64>& white, const std::array<int8_t,64>& black, SimdLevel level);
+
+// with the best supported level
+AttackCountSummary summarizeAttackCounts(const std::array<int8_t,64>& white, const std::array<int8_t,64>& black);
+
+}
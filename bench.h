@@ -0,0 +1,370 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "attackcount.h"
+#include "bitboard.h"
+#include "engine.h"
+#include "eval.h"
+#include "kpk.h"
+#include "log.h"
+#include "movegen.h"
+#include "nnue.h"
+#include "pawns.h"
+
+// counts allocator calls for the search benchmark, bench.h is included by the main translation unit only.
+// The default operator delete frees malloc-ed memory, so it is not replaced.
+inline std::atomic<size_t> benchAllocationCount{0};
+
+void* operator new(size_t size) {
+  benchAllocationCount.fetch_add(1, std::memory_order_relaxed);
+  if(void* ptr = std::malloc(size ? size : 1)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+namespace chesseng {
+
+constexpr int16_t BENCH_SEARCH_DEPTH = 5;
+
+constexpr size_t BENCH_SLIDER_OCCUPANCIES = 4096;
+constexpr size_t BENCH_SLIDER_ROUNDS = 20;
+
+constexpr size_t BENCH_ATTACK_COUNT_ROUNDS = 200000;
+
+constexpr size_t BENCH_EVALUATE_POSITIONS = 200000;
+
+constexpr size_t BENCH_NNUE_POSITIONS = 100000;
+// positions whose moves are made and evaluated
+constexpr size_t BENCH_NNUE_MOVE_STEP = 10;
+constexpr size_t BENCH_NNUE_CACHED_BOARDS = 256;
+
+constexpr size_t BENCH_KPK_PROBES = 10000000;
+
+constexpr int16_t BENCH_SMP_DEPTH = 6;
+
+template<class Lookup>
+void bench_sliderVariant(const std::string& name, const std::vector<Bitboard>& occupancies, Lookup lookup) {
+  auto startTime = std::chrono::steady_clock::now();
+  Bitboard checksum = 0;
+  for(size_t round=0;round<BENCH_SLIDER_ROUNDS;round++) {
+    for(Bitboard occupancy : occupancies) {
+      for(uint8_t pos=0;pos<64;pos++) {
+        checksum += lookup(pos, occupancy);
+      }
+    }
+  }
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+  size_t lookups = BENCH_SLIDER_ROUNDS * occupancies.size() * 64;
+  std::stringstream ss;
+  ss << name << ": " << (ns / 1000000) << "ms, " << (double)ns / lookups << "ns per queen lookup, checksum " << std::hex << checksum;
+  Log::logAndPrint(ss.str());
+}
+
+// queen attacks (rook + bishop lookup) for random occupancies on every square
+void bench_sliders() {
+  std::vector<Bitboard> occupancies;
+  uint64_t state = 0x2545f4914f6cdd1dULL;
+  for(size_t i=0;i<BENCH_SLIDER_OCCUPANCIES;i++) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    Bitboard occupancy = state;
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    occupancies.push_back(occupancy & state);
+  }
+
+  auto tablesStartTime = std::chrono::steady_clock::now();
+  SliderAttacks magicAttacks(SliderIndexing::MAGIC);
+  auto tablesMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - tablesStartTime).count();
+  std::stringstream ss;
+  ss << "Magic tables: " << magicAttacks.getSizeBytes() / 1024 << "KB, generated in " << tablesMs << "ms";
+  Log::logAndPrint(ss.str());
+
+  bench_sliderVariant("Ray walk", occupancies, [](uint8_t pos, Bitboard occupancy) {
+    return rookRayAttacks(pos, occupancy) | bishopRayAttacks(pos, occupancy);
+  });
+  bench_sliderVariant("Magic", occupancies, [&magicAttacks](uint8_t pos, Bitboard occupancy) {
+    return magicAttacks.rookAttacks<SliderIndexing::MAGIC>(pos, occupancy) | magicAttacks.bishopAttacks<SliderIndexing::MAGIC>(pos, occupancy);
+  });
+  #if defined(__BMI2__)
+  SliderAttacks pextAttacks(SliderIndexing::PEXT);
+  bench_sliderVariant("PEXT", occupancies, [&pextAttacks](uint8_t pos, Bitboard occupancy) {
+    return pextAttacks.rookAttacks<SliderIndexing::PEXT>(pos, occupancy) | pextAttacks.bishopAttacks<SliderIndexing::PEXT>(pos, occupancy);
+  });
+  #else
+  Log::logAndPrint("PEXT: not built, compile with -mbmi2 or -march=native");
+  #endif
+}
+
+// attack count summary of positions along a game, for every SIMD level the CPU supports
+void bench_attackCounts() {
+  std::vector<Board> boards;
+  Board board;
+  board.startingPosition();
+  for(const char* move : {"e2e4", "c7c5", "g1f3", "d7d6", "d2d4", "c5d4", "f3d4", "g8f6", "b1c3", "a7a6"}) {
+    board = Board::makeMove(board, move);
+    boards.push_back(board);
+  }
+
+  std::stringstream ss;
+  ss << "Supported: " << getSimdLevelName(getSimdLevel());
+  Log::logAndPrint(ss.str());
+  for(uint8_t level=0;level<=static_cast<uint8_t>(getSimdLevel());level++) {
+    auto startTime = std::chrono::steady_clock::now();
+    Bitboard checksum = 0;
+    for(size_t round=0;round<BENCH_ATTACK_COUNT_ROUNDS;round++) {
+      const Board& roundBoard = boards[round % boards.size()];
+      AttackCountSummary summary = summarizeAttackCounts(roundBoard.attackCount[0], roundBoard.attackCount[1], static_cast<SimdLevel>(level));
+      checksum += summary.whiteMore ^ summary.blackAttacked ^ summary.whiteTotal;
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+    ss.str("");
+    ss << getSimdLevelName(static_cast<SimdLevel>(level)) << ": " << (double)ns / BENCH_ATTACK_COUNT_ROUNDS << "ns per summary, checksum " << std::hex << checksum;
+    Log::logAndPrint(ss.str());
+  }
+}
+
+// positions along pseudo-random games from the starting position
+std::vector<Board> generateBenchBoards(size_t count) {
+  std::vector<Board> boards;
+  boards.reserve(count);
+  uint64_t state = 0x2545f4914f6cdd1dULL;
+  while(boards.size() < count) {
+    Board board;
+    board.startingPosition();
+    for(size_t ply=0;ply<120 && boards.size() < count;ply++) {
+      MoveList moves;
+      generateMoves(board, moves);
+      if(moves.size() == 0) {
+        break;
+      }
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+      UndoRecord undo;
+      board.doMove(moves[state % moves.size()], undo);
+      boards.push_back(board);
+    }
+  }
+  return boards;
+}
+
+void bench_evaluateVariant(const std::string& name, size_t positions, int64_t ns, int64_t checksum) {
+  std::stringstream ss;
+  ss << name << ": " << (ns / 1000000) << "ms, " << (ns > 0 ? positions * 1000000000 / ns / 1000 : 0) << "K positions per second, checksum " << checksum;
+  Log::logAndPrint(ss.str());
+}
+
+// static evaluation of positions along pseudo-random games, with and without move generation
+void bench_evaluate() {
+  std::vector<Board> boards = generateBenchBoards(BENCH_EVALUATE_POSITIONS);
+
+  auto startTime = std::chrono::steady_clock::now();
+  int64_t checksum = 0;
+  for(const Board& board : boards) {
+    checksum += Engine::evaluateBoard(board).score;
+  }
+  bench_evaluateVariant("Engine::evaluateBoard", boards.size(), std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count(), checksum);
+
+  startTime = std::chrono::steady_clock::now();
+  checksum = 0;
+  for(const Board& board : boards) {
+    checksum += evaluate(board);
+  }
+  bench_evaluateVariant("evaluate", boards.size(), std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count(), checksum);
+}
+
+// network evaluation: accumulator refresh, output layer per SIMD level, and make/evaluate/unmake of every legal move
+// against the hand-written evaluation; random weights unless a network file is given
+void bench_nnue(const std::string& networkPath) {
+  NnueNetwork network = NnueNetwork::random(1);
+  if(!networkPath.empty() && !network.loadFile(networkPath)) {
+    Log::logAndPrint("Could not load network: " + networkPath);
+    return;
+  }
+  std::vector<Board> boards = generateBenchBoards(BENCH_NNUE_POSITIONS);
+
+  auto startTime = std::chrono::steady_clock::now();
+  int64_t checksum = 0;
+  for(Board& board : boards) {
+    board.setNetwork(&network);
+    checksum += board.accumulator[0][0];
+  }
+  bench_evaluateVariant("Accumulator refresh", boards.size(), std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count(), checksum);
+
+  for(uint8_t level=0;level<=static_cast<uint8_t>(getSimdLevel());level++) {
+    startTime = std::chrono::steady_clock::now();
+    checksum = 0;
+    // the same cached boards again and again, the kernel and not memory is measured
+    for(size_t i=0;i<boards.size();i++) {
+      const Board& board = boards[i % BENCH_NNUE_CACHED_BOARDS];
+      checksum += propagateNnue(network, board.accumulator[0], board.accumulator[1], static_cast<SimdLevel>(level));
+    }
+    bench_evaluateVariant(std::string("Output layer, ") + getSimdLevelName(static_cast<SimdLevel>(level)), boards.size(),
+      std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count(), checksum);
+  }
+
+  for(bool useNetwork : {false, true}) {
+    size_t evaluations = 0;
+    checksum = 0;
+    int64_t ns = 0;
+    for(size_t i=0;i<boards.size();i+=BENCH_NNUE_MOVE_STEP) {
+      Board board = boards[i];
+      board.setNetwork(useNetwork ? &network : nullptr);
+      MoveList moves;
+      generateMoves(board, moves);
+      startTime = std::chrono::steady_clock::now();
+      for(const Move& move : moves) {
+        UndoRecord undo;
+        board.doMove(move, undo);
+        checksum += evaluate(board);
+        board.undoMove(move, undo);
+      }
+      ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+      evaluations += moves.size();
+    }
+    bench_evaluateVariant(useNetwork ? "Move, evaluateNnue, undo" : "Move, evaluate, undo", evaluations, ns, checksum);
+  }
+}
+
+// bitbase generation by thread count, probes of random king and pawn squares
+void bench_kpk(size_t maxThreads) {
+  KpkBitbase bitbase;
+  for(size_t threads=1;threads<=maxThreads;threads*=2) {
+    auto startTime = std::chrono::steady_clock::now();
+    bitbase.generate(threads);
+    std::stringstream ss;
+    ss << "KPK generation, " << threads << " threads: " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count() << "ms";
+    Log::logAndPrint(ss.str());
+  }
+
+  uint64_t state = 0x9e3779b97f4a7c15ULL;
+  int64_t wins = 0;
+  auto startTime = std::chrono::steady_clock::now();
+  for(size_t i=0;i<BENCH_KPK_PROBES;i++) {
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    uint8_t pawn = 8 + (state >> 20) % 48;
+    wins += bitbase.probe(Side::WHITE, (state >> 30) & 0b111111, pawn, (state >> 40) & 0b111111, (state >> 50) & 1 ? Side::WHITE : Side::BLACK);
+  }
+  bench_evaluateVariant("KPK probe", BENCH_KPK_PROBES, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count(), wins);
+}
+
+// resident set size from /proc, 0 if not available
+inline size_t getResidentKb() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while(std::getline(status, line)) {
+    if(line.rfind("VmRSS:", 0) == 0) {
+      return std::strtoull(line.c_str() + 6, nullptr, 10);
+    }
+  }
+  return 0;
+}
+
+// fixed depth search from a few positions, reports allocator calls and resident memory per million nodes
+void bench_search() {
+  std::vector<std::vector<std::string>> lines = {
+    {},
+    {"e2e4", "d7d5"},
+    {"d2d4", "g8f6", "c2c4", "e7e6", "b1c3", "f8b4"},
+    {"e2e4", "c7c5", "g1f3", "d7d6", "d2d4", "c5d4", "f3d4", "g8f6", "b1c3", "a7a6"}
+  };
+
+  Engine engine;
+  getPawnTable().resetStats();
+  size_t residentStartKb = getResidentKb();
+  size_t allocationsStart = benchAllocationCount.load();
+  int64_t nodes = 0;
+  auto startTime = std::chrono::steady_clock::now();
+  for(const auto& line : lines) {
+    Board board;
+    board.startingPosition();
+    for(const auto& move : line) {
+      board = Board::makeMove(board, move);
+    }
+    EvalContext context(false);
+    engine.evaluate(board, context, BENCH_SEARCH_DEPTH, MIN_SCORE, MAX_SCORE, 2, true);
+    nodes += context.nodesEvaluated;
+  }
+  auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+  size_t allocations = benchAllocationCount.load() - allocationsStart;
+  size_t residentKb = getResidentKb();
+
+  std::stringstream ss;
+  ss << "Search depth " << BENCH_SEARCH_DEPTH << ": " << nodes << " nodes, " << ms << "ms, " << (ms > 0 ? nodes / ms : 0) << "K nodes per second";
+  Log::logAndPrint(ss.str());
+  ss.str("");
+  ss << "Allocations: " << allocations << ", " << (double)allocations * 1000000 / nodes << " per million nodes";
+  Log::logAndPrint(ss.str());
+  ss.str("");
+  ss << "Resident memory: " << residentKb / 1024 << "MB (" << engine.getHashSizeBytes() / 1024 / 1024 << "MB transposition table), search added "
+    << (double)(residentKb - residentStartKb) * 1000000 / nodes << "KB per million nodes";
+  Log::logAndPrint(ss.str());
+  const PawnTableStats& pawnStats = getPawnTable().getStats();
+  ss.str("");
+  ss << "Pawn table: " << getPawnTable().getSizeBytes() / 1024 << "KB, " << pawnStats.probes << " probes, "
+    << (pawnStats.probes ? 100.0 * pawnStats.hits / pawnStats.probes : 0) << "% hits, " << pawnStats.shieldUpdates << " shield updates";
+  Log::logAndPrint(ss.str());
+}
+
+// time to depth, nodes and nodes per second of findBestMove by parallel search mode and thread count, empty table for every position
+void bench_smp(size_t maxThreads) {
+  std::vector<std::vector<std::string>> lines = {
+    {"e2e4", "d7d5"},
+    {"d2d4", "g8f6", "c2c4", "e7e6", "b1c3", "f8b4"}
+  };
+  for(ParallelSearch mode : {ParallelSearch::LAZY_SMP, ParallelSearch::SPLIT_POINTS}) {
+    for(size_t threads=mode == ParallelSearch::LAZY_SMP ? 1 : 2;threads<=maxThreads;threads*=2) {
+      Engine engine;
+      engine.setThreads(threads);
+      engine.setParallelSearch(mode);
+      int64_t ms = 0;
+      std::vector<SearchThreadStats> totals(threads);
+      for(const auto& line : lines) {
+        Board board;
+        board.startingPosition();
+        for(const auto& move : line) {
+          board = Board::makeMove(board, move);
+        }
+        engine.clearHash();
+        auto startTime = std::chrono::steady_clock::now();
+        engine.findBestMove(board, BENCH_SMP_DEPTH);
+        ms += std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+        for(size_t i=0;i<threads;i++) {
+          const SearchThreadStats& stats = engine.getLastSearchThreadStats()[i];
+          totals[i].nodes += stats.nodes;
+          totals[i].tasks += stats.tasks;
+          totals[i].steals += stats.steals;
+          totals[i].splitPoints += stats.splitPoints;
+        }
+      }
+      int64_t nodes = 0;
+      std::stringstream threadsStats;
+      for(const SearchThreadStats& stats : totals) {
+        nodes += stats.nodes;
+        threadsStats << " " << stats.nodes << "/" << stats.splitPoints << "/" << stats.tasks << "/" << stats.steals;
+      }
+      std::stringstream ss;
+      ss << (mode == ParallelSearch::LAZY_SMP ? "Lazy SMP" : "Split points") << ", threads " << threads << ", depth " << BENCH_SMP_DEPTH << ": " << ms << "ms, "
+        << nodes << " nodes, " << (ms > 0 ? nodes / ms : 0) << "K nodes per second";
+      Log::logAndPrint(ss.str());
+      if(threads > 1) {
+        Log::logAndPrint("  nodes/split points/tasks/steals by thread:" + threadsStats.str());
+      }
+    }
+  }
+}
+
+}
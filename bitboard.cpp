@@ -0,0 +1,96 @@
+#include "bitboard.h"
+
+#include <algorithm>
+
+namespace chesseng {
+namespace {
+constexpr size_t ROOK_TABLE_SIZE = 0x19000;
+constexpr size_t BISHOP_TABLE_SIZE = 0x1480;
+constexpr uint8_t MAGIC_MIN_HIGH_BITS = 6;
+// per-row generator seeds that find all magics within a few thousand candidates
+constexpr std::array<uint64_t,8> MAGIC_SEEDS{728, 10316, 55013, 32803, 12281, 15100, 16645, 255};
+
+inline uint64_t xorshift64star(uint64_t& state) {
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  return state * 2685821657736338717ULL;
+}
+
+// magics with few set bits are found much faster
+inline Bitboard sparseRandom(uint64_t& state) {
+  return xorshift64star(state) & xorshift64star(state) & xorshift64star(state);
+}
+
+// occupancy bits that can block the slider, board edges never block
+Bitboard getRelevantMask(uint8_t pos, bool rook) {
+  Bitboard edges = ((rowBB(0) | rowBB(7)) & ~rowBB(pos >> 3)) | ((colBB(0) | colBB(7)) & ~colBB(pos & 0b111));
+  return (rook ? rookRayAttacks(pos, 0) : bishopRayAttacks(pos, 0)) & ~edges;
+}
+}
+
+const SliderAttacks SLIDER_ATTACKS(DEFAULT_SLIDER_INDEXING);
+
+SliderAttacks::SliderAttacks(SliderIndexing indexing) {
+  table.resize(ROOK_TABLE_SIZE + BISHOP_TABLE_SIZE);
+  size_t tableOffset = 0;
+  initPiece(rookMagics, true, indexing, tableOffset);
+  initPiece(bishopMagics, false, indexing, tableOffset);
+}
+
+void SliderAttacks::initPiece(std::array<SliderMagic,64>& magics, bool rook, SliderIndexing indexing, size_t& tableOffset) {
+  std::vector<Bitboard> occupancies;
+  std::vector<Bitboard> references;
+  std::vector<uint32_t> attempts;
+
+  for(uint8_t pos=0;pos<64;pos++) {
+    SliderMagic& magic = magics[pos];
+    magic.mask = getRelevantMask(pos, rook);
+    uint8_t bits = popcount(magic.mask);
+    magic.shift = 64 - bits;
+    size_t size = size_t(1) << bits;
+    Bitboard* attacks = &table[tableOffset];
+    magic.attacks = attacks;
+    tableOffset += size;
+
+    // enumerate all blocker subsets of the mask, n-th subset has PEXT index n
+    occupancies.clear();
+    references.clear();
+    Bitboard subset = 0;
+    do {
+      occupancies.push_back(subset);
+      references.push_back(rook ? rookRayAttacks(pos, subset) : bishopRayAttacks(pos, subset));
+      subset = (subset - magic.mask) & magic.mask;
+    } while(subset);
+
+    if(indexing == SliderIndexing::PEXT) {
+      std::copy(references.begin(), references.end(), attacks);
+      continue;
+    }
+
+    // search for a magic that maps every subset to a slot without destructive collisions
+    uint64_t randomState = MAGIC_SEEDS[pos >> 3];
+    attempts.assign(size, 0);
+    for(uint32_t attempt=1;;attempt++) {
+      do {
+        magic.magic = sparseRandom(randomState);
+      } while(popcount((magic.mask * magic.magic) >> 56) < MAGIC_MIN_HIGH_BITS);
+
+      bool valid = true;
+      for(size_t i=0;i<size && valid;i++) {
+        uint32_t index = magic.index<SliderIndexing::MAGIC>(occupancies[i]);
+        if(attempts[index] < attempt) {
+          attempts[index] = attempt;
+          attacks[index] = references[i];
+        } else if(attacks[index] != references[i]) {
+          valid = false;
+        }
+      }
+      if(valid) {
+        break;
+      }
+    }
+  }
+}
+
+}
@@ -0,0 +1,295 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace chesseng {
+
+// bit index = row*8 + col, same as Position::data
+typedef uint64_t Bitboard;
+
+constexpr Bitboard ROW_1_BB = 0xffULL;
+constexpr Bitboard FILE_A_BB = 0x0101010101010101ULL;
+constexpr Bitboard CENTER_BB = (1ULL<<27) | (1ULL<<28) | (1ULL<<35) | (1ULL<<36);
+constexpr Bitboard NEAR_CENTER_BB = 0x00003c3c3c3c0000ULL & ~CENTER_BB;
+// a1 is dark
+constexpr Bitboard DARK_SQUARES_BB = 0xaa55aa55aa55aa55ULL;
+
+constexpr Bitboard squareBB(uint8_t pos) {
+  return 1ULL << pos;
+}
+
+constexpr Bitboard rowBB(uint8_t row) {
+  return ROW_1_BB << (row * 8);
+}
+
+constexpr Bitboard colBB(uint8_t col) {
+  return FILE_A_BB << col;
+}
+
+// bb must not be 0 for lsb and msb
+#if defined(_MSC_VER)
+inline int popcount(Bitboard bb) {
+  return static_cast<int>(__popcnt64(bb));
+}
+
+inline uint8_t lsb(Bitboard bb) {
+  unsigned long index;
+  _BitScanForward64(&index, bb);
+  return static_cast<uint8_t>(index);
+}
+
+inline uint8_t msb(Bitboard bb) {
+  unsigned long index;
+  _BitScanReverse64(&index, bb);
+  return static_cast<uint8_t>(index);
+}
+#else
+inline int popcount(Bitboard bb) {
+  return __builtin_popcountll(bb);
+}
+
+inline uint8_t lsb(Bitboard bb) {
+  return __builtin_ctzll(bb);
+}
+
+inline uint8_t msb(Bitboard bb) {
+  return 63 - __builtin_clzll(bb);
+}
+#endif
+
+// king moves between two squares
+inline uint8_t getDistance(uint8_t pos1, uint8_t pos2) {
+  int8_t rowDistance = (pos1 >> 3) - (pos2 >> 3);
+  int8_t colDistance = (pos1 & 0b111) - (pos2 & 0b111);
+  return std::max(std::abs(rowDistance), std::abs(colDistance));
+}
+
+inline uint8_t popLsb(Bitboard& bb) {
+  uint8_t pos = lsb(bb);
+  bb &= bb - 1;
+  return pos;
+}
+
+// ray directions, first four go towards higher bit indexes
+enum Direction: uint8_t {
+  NORTH=0,
+  EAST=1,
+  NORTH_EAST=2,
+  NORTH_WEST=3,
+  SOUTH=4,
+  WEST=5,
+  SOUTH_WEST=6,
+  SOUTH_EAST=7
+};
+
+constexpr std::array<int8_t,8> DIRECTION_ROW_DELTA{1, 0, 1, 1, -1, 0, -1, -1};
+constexpr std::array<int8_t,8> DIRECTION_COL_DELTA{0, 1, 1, -1, 0, -1, -1, 1};
+
+typedef std::array<Bitboard,64> SquareTable;
+
+constexpr Bitboard deltaBB(uint8_t pos, int8_t rowDelta, int8_t colDelta) {
+  int8_t row = (pos >> 3) + rowDelta;
+  int8_t col = (pos & 0b111) + colDelta;
+  if(row < 0 || row >= 8 || col < 0 || col >= 8) {
+    return 0;
+  }
+  return squareBB(row * 8 + col);
+}
+
+constexpr SquareTable generateKnightAttacks() {
+  constexpr std::array<std::array<int8_t,2>,8> knightDeltas{{{-2,-1},{-2,1},{-1,-2},{-1,2},{1,-2},{1,2},{2,-1},{2,1}}};
+  SquareTable table{};
+  for(uint8_t pos=0;pos<64;pos++) {
+    for(const auto& delta : knightDeltas) {
+      table[pos] |= deltaBB(pos, delta[0], delta[1]);
+    }
+  }
+  return table;
+}
+
+constexpr SquareTable generateKingAttacks() {
+  SquareTable table{};
+  for(uint8_t pos=0;pos<64;pos++) {
+    for(int8_t rowDelta=-1;rowDelta<=1;rowDelta++) {
+      for(int8_t colDelta=-1;colDelta<=1;colDelta++) {
+        if(rowDelta != 0 || colDelta != 0) {
+          table[pos] |= deltaBB(pos, rowDelta, colDelta);
+        }
+      }
+    }
+  }
+  return table;
+}
+
+// indexed by side: white pawns attack up, black pawns attack down
+constexpr std::array<SquareTable,2> generatePawnAttacks() {
+  std::array<SquareTable,2> table{};
+  for(uint8_t pos=0;pos<64;pos++) {
+    table[0][pos] = deltaBB(pos, 1, -1) | deltaBB(pos, 1, 1);
+    table[1][pos] = deltaBB(pos, -1, -1) | deltaBB(pos, -1, 1);
+  }
+  return table;
+}
+
+// squares from pos to the board edge in each direction, pos excluded
+constexpr std::array<SquareTable,8> generateRays() {
+  std::array<SquareTable,8> rays{};
+  for(uint8_t dir=0;dir<8;dir++) {
+    for(uint8_t pos=0;pos<64;pos++) {
+      for(int8_t step=1;step<8;step++) {
+        rays[dir][pos] |= deltaBB(pos, DIRECTION_ROW_DELTA[dir]*step, DIRECTION_COL_DELTA[dir]*step);
+      }
+    }
+  }
+  return rays;
+}
+
+// squares strictly between two squares on a common line, 0 if not aligned
+constexpr std::array<SquareTable,64> generateBetween(const std::array<SquareTable,8>& rays) {
+  std::array<SquareTable,64> between{};
+  for(uint8_t from=0;from<64;from++) {
+    for(uint8_t dir=0;dir<8;dir++) {
+      for(uint8_t to=0;to<64;to++) {
+        if(rays[dir][from] & squareBB(to)) {
+          between[from][to] = rays[dir][from] & ~rays[dir][to] & ~squareBB(to);
+        }
+      }
+    }
+  }
+  return between;
+}
+
+// whole line through two aligned squares, 0 if not aligned
+constexpr std::array<SquareTable,64> generateLines(const std::array<SquareTable,8>& rays) {
+  std::array<SquareTable,64> lines{};
+  for(uint8_t from=0;from<64;from++) {
+    for(uint8_t dir=0;dir<8;dir++) {
+      // opposite direction is 4 apart
+      Bitboard line = rays[dir][from] | rays[(dir + 4) % 8][from] | squareBB(from);
+      for(uint8_t to=0;to<64;to++) {
+        if(rays[dir][from] & squareBB(to)) {
+          lines[from][to] = line;
+        }
+      }
+    }
+  }
+  return lines;
+}
+
+inline constexpr SquareTable KNIGHT_ATTACKS = generateKnightAttacks();
+inline constexpr SquareTable KING_ATTACKS = generateKingAttacks();
+inline constexpr std::array<SquareTable,2> PAWN_ATTACKS = generatePawnAttacks();
+inline constexpr std::array<SquareTable,8> RAYS = generateRays();
+inline constexpr std::array<SquareTable,64> BETWEEN = generateBetween(RAYS);
+inline constexpr std::array<SquareTable,64> LINE = generateLines(RAYS);
+
+// ray up to and including the first occupied square
+inline Bitboard rayAttacks(uint8_t pos, Bitboard occupancy, Direction dir) {
+  Bitboard ray = RAYS[dir][pos];
+  Bitboard blockers = ray & occupancy;
+  if(blockers) {
+    uint8_t blocker = dir < SOUTH ? lsb(blockers) : msb(blockers);
+    ray ^= RAYS[dir][blocker];
+  }
+  return ray;
+}
+
+// slider attacks by walking rays, reference for the lookup tables
+inline Bitboard rookRayAttacks(uint8_t pos, Bitboard occupancy) {
+  return rayAttacks(pos, occupancy, NORTH) | rayAttacks(pos, occupancy, EAST)
+    | rayAttacks(pos, occupancy, SOUTH) | rayAttacks(pos, occupancy, WEST);
+}
+
+inline Bitboard bishopRayAttacks(uint8_t pos, Bitboard occupancy) {
+  return rayAttacks(pos, occupancy, NORTH_EAST) | rayAttacks(pos, occupancy, NORTH_WEST)
+    | rayAttacks(pos, occupancy, SOUTH_EAST) | rayAttacks(pos, occupancy, SOUTH_WEST);
+}
+
+enum class SliderIndexing: uint8_t {
+  // (occupancy & mask) * magic >> shift
+  MAGIC=0,
+  // BMI2 parallel bit extract of occupancy & mask
+  PEXT=1
+};
+
+// PEXT is selected at build time, e.g. -mbmi2 or -march=native on CPUs with BMI2
+#if defined(__BMI2__)
+constexpr SliderIndexing DEFAULT_SLIDER_INDEXING = SliderIndexing::PEXT;
+#else
+constexpr SliderIndexing DEFAULT_SLIDER_INDEXING = SliderIndexing::MAGIC;
+#endif
+
+struct SliderMagic {
+  template<SliderIndexing indexing>
+  inline uint32_t index(Bitboard occupancy) const {
+    #if defined(__BMI2__)
+    if(indexing == SliderIndexing::PEXT) {
+      return _pext_u64(occupancy, mask);
+    }
+    #endif
+    return ((occupancy & mask) * magic) >> shift;
+  }
+
+  // relevant occupancy: rays without the board edge
+  Bitboard mask{0};
+  Bitboard magic{0};
+  const Bitboard* attacks{nullptr};
+  uint8_t shift{0};
+};
+
+// rook and bishop attack lookup tables, generated at startup
+class SliderAttacks {
+  public:
+  explicit SliderAttacks(SliderIndexing indexing);
+
+  template<SliderIndexing indexing>
+  inline Bitboard rookAttacks(uint8_t pos, Bitboard occupancy) const {
+    const SliderMagic& magic = rookMagics[pos];
+    return magic.attacks[magic.index<indexing>(occupancy)];
+  }
+
+  template<SliderIndexing indexing>
+  inline Bitboard bishopAttacks(uint8_t pos, Bitboard occupancy) const {
+    const SliderMagic& magic = bishopMagics[pos];
+    return magic.attacks[magic.index<indexing>(occupancy)];
+  }
+
+  size_t getSizeBytes() const {
+    return table.size() * sizeof(Bitboard);
+  }
+
+  private:
+  void initPiece(std::array<SliderMagic,64>& magics, bool rook, SliderIndexing indexing, size_t& tableOffset);
+
+  std::array<SliderMagic,64> rookMagics;
+  std::array<SliderMagic,64> bishopMagics;
+  std::vector<Bitboard> table;
+};
+
+extern const SliderAttacks SLIDER_ATTACKS;
+
+inline Bitboard rookAttacks(uint8_t pos, Bitboard occupancy) {
+  return SLIDER_ATTACKS.rookAttacks<DEFAULT_SLIDER_INDEXING>(pos, occupancy);
+}
+
+inline Bitboard bishopAttacks(uint8_t pos, Bitboard occupancy) {
+  return SLIDER_ATTACKS.bishopAttacks<DEFAULT_SLIDER_INDEXING>(pos, occupancy);
+}
+
+inline Bitboard queenAttacks(uint8_t pos, Bitboard occupancy) {
+  return rookAttacks(pos, occupancy) | bishopAttacks(pos, occupancy);
+}
+
+}
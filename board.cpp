@@ -1,9 +1,31 @@
 #include <assert.h>
+#include <cctype>
 #include <sstream>
 
 #include "board.h"
 
+// check incremental hashes, pst score and attack counts against full recomputation after every move
+#define VERIFY_HASH 0
+
 namespace chesseng {
+namespace {
+// castling rights that survive a move from or to the square
+constexpr std::array<uint8_t,64> generateCastlingRightsKept() {
+  std::array<uint8_t,64> kept{};
+  for(uint8_t pos=0;pos<64;pos++) {
+    kept[pos] = ALL_CASTLING;
+  }
+  kept[4] &= ~(WHITE_SHORT_CASTLING | WHITE_LONG_CASTLING);
+  kept[7] &= ~WHITE_SHORT_CASTLING;
+  kept[0] &= ~WHITE_LONG_CASTLING;
+  kept[60] &= ~(BLACK_SHORT_CASTLING | BLACK_LONG_CASTLING);
+  kept[63] &= ~BLACK_SHORT_CASTLING;
+  kept[56] &= ~BLACK_LONG_CASTLING;
+  return kept;
+}
+
+constexpr std::array<uint8_t,64> CASTLING_RIGHTS_KEPT = generateCastlingRightsKept();
+}
 
 Board::Board() {
   squares.fill(Square(0));
@@ -38,6 +60,7 @@ std::string Board::logBoard() const {
   }
 
   out << "Move:" << ((gamestate&WHOSE_TURN_BIT)?"BLACK":"WHITE")<<std::endl;
+  out << "Castling:" << (int)getCastlingRights() << " EnPassantCol:" << (int)getEnPassantCol() << " HalfmoveClock:" << (int)getHalfmoveClock() << std::endl;
   for(int8_t row=7;row>=0;row--) {
     out << boardPrint[row] << std::endl;
   }
@@ -67,80 +90,277 @@ void Board::startingPosition() {
   setSquare(Position(7,4), Square(PieceType::KING_PIECE, SideBit::BLACK));
 
   setMovingSide(Side::WHITE);
+  setCastlingRights(ALL_CASTLING);
 }
 
-Board Board::makeMove(const Board& board, Move move) {
-  return Board::makeMove(board, move.getFrom(), move.getTo(), move.getPromotionType());
+bool Board::loadFen(const std::string& fen) {
+  std::istringstream sstream(fen);
+  std::string placement, side, castling, enPassant;
+  int32_t halfmoveClock = 0;
+  sstream >> placement >> side >> castling >> enPassant;
+  if(!(sstream >> halfmoveClock)) {
+    halfmoveClock = 0;
+  }
+  if(placement.empty() || side.empty()) {
+    return false;
+  }
+
+  *this = Board();
+  int8_t row = 7;
+  int8_t col = 0;
+  for(char c : placement) {
+    if(c == '/') {
+      row--;
+      col = 0;
+      continue;
+    }
+    if(c >= '1' && c <= '8') {
+      col += c - '0';
+      continue;
+    }
+    PieceType pieceType = PieceType::NO_PIECE;
+    switch(std::tolower(c)) {
+      case 'p': pieceType = PieceType::PAWN_PIECE; break;
+      case 'r': pieceType = PieceType::ROOK_PIECE; break;
+      case 'n': pieceType = PieceType::KNIGHT_PIECE; break;
+      case 'b': pieceType = PieceType::BISHOP_PIECE; break;
+      case 'q': pieceType = PieceType::QUEEN_PIECE; break;
+      case 'k': pieceType = PieceType::KING_PIECE; break;
+      default: return false;
+    }
+    if(!rowcolok(row) || !rowcolok(col)) {
+      return false;
+    }
+    setSquare(Position(row, col), Square(pieceType, std::isupper(c) ? SideBit::WHITE : SideBit::BLACK));
+    col++;
+  }
+
+  setMovingSide(side == "b" ? Side::BLACK : Side::WHITE);
+
+  uint8_t castlingRights = 0;
+  for(char c : castling) {
+    castlingRights |= c == 'K' ? WHITE_SHORT_CASTLING : c == 'Q' ? WHITE_LONG_CASTLING : c == 'k' ? BLACK_SHORT_CASTLING : c == 'q' ? BLACK_LONG_CASTLING : 0;
+  }
+  setCastlingRights(castlingRights);
+
+  // en passant col is set only if a pawn of the moving side can capture, same as in doMove
+  if(enPassant.size() == 2 && enPassant[0] >= 'a' && enPassant[0] <= 'h') {
+    Position enPassantPos(enPassant[1] - '1', enPassant[0] - 'a');
+    Side movingSide = getMovingSide();
+    if(PAWN_ATTACKS[static_cast<uint8_t>(getOpponentSide(movingSide))][enPassantPos.data] & getPieces(movingSide, PieceType::PAWN_PIECE)) {
+      setEnPassantCol(enPassantPos.getCol());
+    }
+  }
+  setHalfmoveClock(std::clamp(halfmoveClock, 0, (int32_t)MAX_HALFMOVE_CLOCK));
+  return true;
 }
-Board Board::makeMove(const Board& board, Position fromPos, Position toPos, PieceType promotionType) {
-  Board result(board);
 
-  // clear moved twice bit
-  for(int8_t row=3;row<=4;row++){
-    for(int8_t col=0;col<8;col++) {
-      Square maybePawn = result.getSquare(row,col);
-      if(maybePawn.getPawnMovedTwiceBit()==PawnMovedTwiceBit::YES && maybePawn.getPieceType()==PieceType::PAWN_PIECE) {
-        result.setSquare(Position(row,col),Square(maybePawn.getPieceType(),maybePawn.getSideBit(),maybePawn.getMovedBit()));
-      }
+uint64_t Board::computeHash() const {
+  uint64_t res = 0;
+  for(size_t posIndex=0;posIndex<64;posIndex++) {
+    res ^= ZOBRIST.square[posIndex][squares[posIndex].data];
+  }
+  if(getMovingSide() == Side::BLACK) {
+    res ^= ZOBRIST.blackToMove;
+  }
+  res ^= ZOBRIST.castling[getCastlingRights()];
+  res ^= ZOBRIST.enPassant[getEnPassantCol() + 1];
+  return res;
+}
+
+uint64_t Board::computePawnKey() const {
+  uint64_t res = 0;
+  for(size_t posIndex=0;posIndex<64;posIndex++) {
+    if(squares[posIndex].getPieceType() == PieceType::PAWN_PIECE) {
+      res ^= ZOBRIST.square[posIndex][squares[posIndex].data];
     }
   }
-  
-  result.setMovingSide(result.getMovingSide() == Side::WHITE ? Side::BLACK : Side::WHITE);
-  Square movingPiece = result.getSquare(fromPos);
+  return res;
+}
 
-  result.setSquare(fromPos, Square(PieceType::NO_PIECE, SideBit::WHITE));
-  result.setSquare(toPos, Square(movingPiece.getPieceType(), movingPiece.getSideBit(), MovedBit::YES));
+PstScore Board::computePstScore() const {
+  PstScore res;
+  for(size_t posIndex=0;posIndex<64;posIndex++) {
+    res += PST[squares[posIndex].data][posIndex];
+  }
+  return res;
+}
 
-  
-  if(movingPiece.getPieceType() == PieceType::PAWN_PIECE) {
-    // en passant
-    if(fromPos.getCol() != toPos.getCol() && board.getSquare(toPos).getPieceType() == PieceType::NO_PIECE) {
-      int8_t enpassantCaptureRow = fromPos.getRow();
-      int8_t enpassantCaptureCol = toPos.getCol();
-      result.setSquare(Position(enpassantCaptureRow, enpassantCaptureCol), Square(PieceType::NO_PIECE, SideBit::WHITE));
+uint8_t Board::computePhase() const {
+  uint8_t res = 0;
+  for(size_t posIndex=0;posIndex<64;posIndex++) {
+    res += PHASE_WEIGHT[static_cast<uint8_t>(squares[posIndex].getPieceType())];
+  }
+  return res;
+}
+
+uint64_t Board::computeMaterialKey() const {
+  uint64_t res = 0;
+  for(size_t posIndex=0;posIndex<64;posIndex++) {
+    res += MATERIAL_KEY_UNIT[squares[posIndex].data];
+  }
+  return res;
+}
+
+std::array<std::array<int8_t,64>,2> Board::computeAttackCount() const {
+  std::array<std::array<int8_t,64>,2> res{};
+  Bitboard occupancy = getOccupancy();
+  for(size_t posIndex=0;posIndex<64;posIndex++) {
+    Square square = squares[posIndex];
+    auto& sideAttackCount = res[static_cast<uint8_t>(getSide(square.getSideBit()))];
+    for(Bitboard attacks = getAttacks(square, posIndex, occupancy); attacks; ) {
+      sideAttackCount[popLsb(attacks)] += 1;
     }
-    // moved twice
-    int16_t rowDelta =(int16_t)fromPos.getRow()-(int16_t)toPos.getRow();
-    if(std::abs(rowDelta) == 2) {
-      result.setSquare(toPos, Square(movingPiece.getPieceType(), movingPiece.getSideBit(), MovedBit::YES, PawnMovedTwiceBit::YES));
+  }
+  return res;
+}
+
+NnueAccumulator Board::computeAccumulator() const {
+  if(!network) {
+    return NnueAccumulator();
+  }
+  NnueAccumulator res(2);
+  for(uint8_t perspective=0;perspective<2;perspective++) {
+    res[perspective] = network->featureBias;
+    for(size_t posIndex=0;posIndex<64;posIndex++) {
+      Square square = squares[posIndex];
+      if(square.getPieceType() != PieceType::NO_PIECE) {
+        size_t feature = getNnueFeature(perspective, static_cast<uint8_t>(square.getPieceType()), static_cast<uint8_t>(getSide(square.getSideBit())), posIndex);
+        addNnueFeature(res[perspective], network->getFeatureWeights(feature));
+      }
     }
   }
+  return res;
+}
 
-  // castling
-  if(movingPiece.getPieceType() == PieceType::KING_PIECE) {
-    if(fromPos.getCol() == 4 && toPos.getCol() == 6) {
-      // short castling: K col 4=>6
-      Square expectRook = result.getSquare(fromPos.getRow(), 7);
-      result.setSquare(Position(fromPos.getRow(),7), Square(PieceType::NO_PIECE, SideBit::WHITE));
-      result.setSquare(Position(fromPos.getRow(),5), Square(expectRook.getPieceType(),expectRook.getSideBit(),MovedBit::YES));
-    } else if (fromPos.getCol() == 4 && toPos.getCol() == 2) {
-      // long castling: K col 4=>2
-      Square expectRook = result.getSquare(fromPos.getRow(), 0);
-      result.setSquare(Position(fromPos.getRow(),0), Square(PieceType::NO_PIECE, SideBit::WHITE));
-      result.setSquare(Position(fromPos.getRow(),3),  Square(expectRook.getPieceType(),expectRook.getSideBit(),MovedBit::YES));
+void Board::setNetwork(const NnueNetwork* newNetwork) {
+  network = newNetwork;
+  accumulator = computeAccumulator();
+}
+
+template<bool updateAttacks>
+void Board::doMove(Move move, UndoRecord& undo) {
+  Position fromPos = move.getFrom();
+  Position toPos = move.getTo();
+  MoveFlag flag = move.getFlag();
+  undo.hash = hash;
+  undo.gamestate = gamestate;
+  if(updateAttacks) {
+    undo.attackCount = attackCount;
+  }
+
+  Square movingPiece = getSquare(fromPos);
+  bool isPawnMove = movingPiece.getPieceType() == PieceType::PAWN_PIECE;
+  undo.movingPiece = movingPiece;
+  undo.capturedPos = flag == MoveFlag::EN_PASSANT ? Position(fromPos.getRow(), toPos.getCol()) : toPos;
+  undo.capturedPiece = getSquare(undo.capturedPos);
+
+  Side movingSide = getMovingSide();
+  setMovingSide(getOpponentSide(movingSide));
+  setEnPassantCol(NO_COL);
+  setCastlingRights(getCastlingRights() & CASTLING_RIGHTS_KEPT[fromPos.data] & CASTLING_RIGHTS_KEPT[toPos.data]);
+  setHalfmoveClock(isPawnMove || move.isCapture() ? 0 : getHalfmoveClock() + 1);
+
+  setSquare(fromPos, Square(PieceType::NO_PIECE, SideBit::WHITE), updateAttacks);
+  setSquare(undo.capturedPos, Square(PieceType::NO_PIECE, SideBit::WHITE), updateAttacks);
+  setSquare(toPos, move.isPromotion() ? Square(move.getPromotionType(), movingPiece.getSideBit()) : movingPiece, updateAttacks);
+
+  // en passant col is set only if an opponent pawn can capture
+  if(flag == MoveFlag::DOUBLE_PAWN_PUSH) {
+    uint8_t passedPos = Position((fromPos.getRow() + toPos.getRow()) / 2, toPos.getCol()).data;
+    if(PAWN_ATTACKS[static_cast<uint8_t>(movingSide)][passedPos] & getPieces(getOpponentSide(movingSide), PieceType::PAWN_PIECE)) {
+      setEnPassantCol(toPos.getCol());
     }
   }
 
-  // promotion
-  if(promotionType != PieceType::NO_PIECE) {
-    result.setSquare(toPos, Square(promotionType, movingPiece.getSideBit(), MovedBit::YES));
+  // castling
+  if(flag == MoveFlag::KING_CASTLE) {
+    // short castling: K col 4=>6
+    Square rook = getSquare(fromPos.getRow(), 7);
+    setSquare(Position(fromPos.getRow(),7), Square(PieceType::NO_PIECE, SideBit::WHITE), updateAttacks);
+    setSquare(Position(fromPos.getRow(),5), rook, updateAttacks);
+  } else if (flag == MoveFlag::QUEEN_CASTLE) {
+    // long castling: K col 4=>2
+    Square rook = getSquare(fromPos.getRow(), 0);
+    setSquare(Position(fromPos.getRow(),0), Square(PieceType::NO_PIECE, SideBit::WHITE), updateAttacks);
+    setSquare(Position(fromPos.getRow(),3), rook, updateAttacks);
+  }
+
+  #if VERIFY_HASH == 1
+  assert(hash == computeHash());
+  assert(pawnKey == computePawnKey());
+  assert(pstScore == computePstScore());
+  assert(phase == computePhase());
+  assert(materialKey == computeMaterialKey());
+  assert(!updateAttacks || attackCount == computeAttackCount());
+  assert(accumulator == computeAccumulator());
+  #endif
+}
+
+template<bool updateAttacks>
+void Board::undoMove(Move move, const UndoRecord& undo) {
+  Position fromPos = move.getFrom();
+  Position toPos = move.getTo();
+
+  // castling
+  if(move.getFlag() == MoveFlag::KING_CASTLE) {
+    Square rook = getSquare(fromPos.getRow(), 5);
+    setSquare(Position(fromPos.getRow(),5), Square(PieceType::NO_PIECE, SideBit::WHITE), false);
+    setSquare(Position(fromPos.getRow(),7), rook, false);
+  } else if (move.getFlag() == MoveFlag::QUEEN_CASTLE) {
+    Square rook = getSquare(fromPos.getRow(), 3);
+    setSquare(Position(fromPos.getRow(),3), Square(PieceType::NO_PIECE, SideBit::WHITE), false);
+    setSquare(Position(fromPos.getRow(),0), rook, false);
+  }
+
+  setSquare(toPos, Square(PieceType::NO_PIECE, SideBit::WHITE), false);
+  setSquare(undo.capturedPos, undo.capturedPiece, false);
+  setSquare(fromPos, undo.movingPiece, false);
+
+  // moving side, castling rights and en passant keys are restored with the saved hash
+  gamestate = undo.gamestate;
+  hash = undo.hash;
+  if(updateAttacks) {
+    attackCount = undo.attackCount;
   }
 
+  #if VERIFY_HASH == 1
+  assert(hash == computeHash());
+  assert(pawnKey == computePawnKey());
+  assert(pstScore == computePstScore());
+  assert(phase == computePhase());
+  assert(materialKey == computeMaterialKey());
+  assert(!updateAttacks || attackCount == computeAttackCount());
+  assert(accumulator == computeAccumulator());
+  #endif
+}
+
+template void Board::doMove<true>(Move move, UndoRecord& undo);
+template void Board::doMove<false>(Move move, UndoRecord& undo);
+template void Board::undoMove<true>(Move move, const UndoRecord& undo);
+template void Board::undoMove<false>(Move move, const UndoRecord& undo);
+
+Board Board::makeMove(const Board& board, Move move) {
+  Board result(board);
+  UndoRecord undo;
+  result.doMove(move, undo);
   return result;
 }
-Board Board::makeMove(const Board& board, std::string move) {
+
+Move Board::parseMove(const std::string& move) const {
   int8_t fromCol = move.at(0) - 'a';
   int8_t fromRow = move.at(1) - '1';
   int8_t toCol = move.at(2) - 'a';
   int8_t toRow = move.at(3) - '1';
   Position fromPos = Position(fromRow,fromCol);
   Position toPos = Position(toRow,toCol);
-  PieceType promotionType = PieceType::NO_PIECE;
+  PieceType movingType = getSquare(fromPos).getPieceType();
+  bool isCapture = getSquare(toPos).getPieceType() != PieceType::NO_PIECE;
 
   // promotion
   if(move.size()>4) {
     char newPieceType = move.at(4);
-    promotionType = PieceType::PAWN_PIECE;
+    PieceType promotionType = PieceType::NO_PIECE;
     if(newPieceType=='q') {
       promotionType = PieceType::QUEEN_PIECE;
     } else if(newPieceType=='r') {
@@ -152,9 +372,32 @@ Board Board::makeMove(const Board& board, std::string move) {
     } else {
       assert(false);
     }
+    return Move(fromPos, toPos, getPromotionFlag(promotionType, isCapture));
+  }
+
+  if(isCapture) {
+    return Move(fromPos, toPos, MoveFlag::CAPTURE);
+  }
+  if(movingType == PieceType::PAWN_PIECE) {
+    if(fromCol != toCol) {
+      return Move(fromPos, toPos, MoveFlag::EN_PASSANT);
+    }
+    if(std::abs(toRow - fromRow) == 2) {
+      return Move(fromPos, toPos, MoveFlag::DOUBLE_PAWN_PUSH);
+    }
+  }
+  if(movingType == PieceType::KING_PIECE && fromCol == 4) {
+    if(toCol == 6) {
+      return Move(fromPos, toPos, MoveFlag::KING_CASTLE);
+    } else if(toCol == 2) {
+      return Move(fromPos, toPos, MoveFlag::QUEEN_CASTLE);
+    }
   }
+  return Move(fromPos, toPos);
+}
 
-  return makeMove(board, fromPos, toPos,promotionType);
+Board Board::makeMove(const Board& board, std::string move) {
+  return makeMove(board, board.parseMove(move));
 }
 
 std::string Move::print() const {
@@ -165,9 +408,7 @@ std::string Move::print() const {
   res[3] = '1' + getTo().getRow();
   PieceType promotionType = getPromotionType();
   if(promotionType!=PieceType::NO_PIECE) {
-    if(promotionType==PieceType::PAWN_PIECE) {
-      res+="p";
-    } else if(promotionType==PieceType::ROOK_PIECE) {
+    if(promotionType==PieceType::ROOK_PIECE) {
       res+="r";
     } else if(promotionType==PieceType::BISHOP_PIECE) {
       res+="b";
@@ -1,30 +1,52 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <assert.h>
 #include <iostream>
 #include <vector>
 #include <string>
 
+#include "bitboard.h"
 #include "log.h"
+#include "nnue.h"
+#include "pst.h"
+#include "zobrist.h"
 
 namespace chesseng {
 
 // piece struct:
-// 0-3 bit: piece type
-// 4 bit: side
+// 0-2 bit: piece type
+// 3 bit: side
 constexpr uint8_t PIECE_MASK=0b111; // 7
 constexpr uint8_t SIDE_BIT=(1<<3);
-constexpr uint8_t MOVED_BIT=(1<<4);
-constexpr uint8_t PAWN_MOVED_TWICE_BIT=(1<<5);
 
 // gamestate struct:
 // 0 bit: whose move
-//
-constexpr uint8_t WHOSE_TURN_BIT = 1;
-enum class WhoseTurnBit: uint8_t {
+// 1-4 bit: castling rights
+// 5-8 bit: en passant col + 1, 0 if no en passant capture is possible
+// 9-15 bit: halfmove clock, not part of the position hash
+constexpr uint16_t WHOSE_TURN_BIT = 1;
+enum class WhoseTurnBit: uint16_t {
   WHITE = 0,
   BLACK = WHOSE_TURN_BIT
 };
+constexpr uint8_t CASTLING_SHIFT = 1;
+constexpr uint16_t CASTLING_MASK = 0b1111 << CASTLING_SHIFT;
+constexpr uint8_t EN_PASSANT_SHIFT = 5;
+constexpr uint16_t EN_PASSANT_MASK = 0b1111 << EN_PASSANT_SHIFT;
+constexpr uint8_t HALFMOVE_CLOCK_SHIFT = 9;
+constexpr uint16_t HALFMOVE_CLOCK_MASK = 0b1111111 << HALFMOVE_CLOCK_SHIFT;
+constexpr uint8_t MAX_HALFMOVE_CLOCK = 127;
+
+// castling rights
+constexpr uint8_t WHITE_SHORT_CASTLING = 1;
+constexpr uint8_t WHITE_LONG_CASTLING = 2;
+constexpr uint8_t BLACK_SHORT_CASTLING = 4;
+constexpr uint8_t BLACK_LONG_CASTLING = 8;
+constexpr uint8_t ALL_CASTLING = 0b1111;
+
+constexpr int8_t NO_COL = -1;
 
 inline bool rowcolok(int8_t rowcol) {
   return rowcol>=0 && rowcol<8;
@@ -50,44 +72,49 @@ enum class PieceType: uint8_t {
   KING_PIECE=6
 };
 
-enum class MovedBit: uint8_t {
-  NO=0,
-  YES=MOVED_BIT
-};
-
-enum class PawnMovedTwiceBit: uint8_t {
-  NO=0,
-  YES=PAWN_MOVED_TWICE_BIT
-};
-
 struct Square {
   public:
   inline Square():data(0){}
   explicit inline Square(uint8_t data):data(data){}
 
-  inline Square(PieceType piece, SideBit sideBit, MovedBit movedBit=MovedBit::NO, PawnMovedTwiceBit movedTwiceBit=PawnMovedTwiceBit::NO) {
-    data = static_cast<uint8_t>(piece) | static_cast<uint8_t>(sideBit) | static_cast<uint8_t>(movedBit) |static_cast<uint8_t>(movedTwiceBit);
+  inline Square(PieceType piece, SideBit sideBit) {
+    data = static_cast<uint8_t>(piece) | static_cast<uint8_t>(sideBit);
   }
 
-  inline PieceType getPieceType(){
+  inline PieceType getPieceType() const {
     return static_cast<PieceType>(data & PIECE_MASK);
   }
 
-  inline SideBit getSideBit() {
+  inline SideBit getSideBit() const {
     return static_cast<SideBit>(data & SIDE_BIT);
   }
 
-  inline MovedBit getMovedBit() {
-    return static_cast<MovedBit>(data & MOVED_BIT);
-  }
-
-  inline PawnMovedTwiceBit getPawnMovedTwiceBit() {
-    return static_cast<PawnMovedTwiceBit>(data & PAWN_MOVED_TWICE_BIT);
-  }
 
   uint8_t data;  
 };
 
+// material key: piece counts by side and piece type, 4 bits each, kings are not counted
+constexpr uint8_t MATERIAL_KEY_BITS = 4;
+constexpr uint8_t MATERIAL_KEY_SIDE_SHIFT = 5*MATERIAL_KEY_BITS;
+constexpr uint64_t MATERIAL_KEY_SIDE_MASK = (1ULL << MATERIAL_KEY_SIDE_SHIFT) - 1;
+
+constexpr uint8_t getMaterialKeyShift(uint8_t side, PieceType pieceType) {
+  return side*MATERIAL_KEY_SIDE_SHIFT + (static_cast<uint8_t>(pieceType) - 1)*MATERIAL_KEY_BITS;
+}
+
+// added to the material key for a piece, indexed by square data
+constexpr std::array<uint64_t,16> generateMaterialKeyUnits() {
+  std::array<uint64_t,16> units{};
+  for(uint8_t side=0;side<2;side++) {
+    for(uint8_t pieceType=1;pieceType<6;pieceType++) {
+      units[pieceType | (side ? SIDE_BIT : 0)] = 1ULL << getMaterialKeyShift(side, static_cast<PieceType>(pieceType));
+    }
+  }
+  return units;
+}
+
+inline constexpr std::array<uint64_t,16> MATERIAL_KEY_UNIT = generateMaterialKeyUnits();
+
 struct Position {
   public:
   Position(uint8_t row, uint8_t col) {
@@ -114,33 +141,122 @@ struct Position {
   uint8_t data;
 };
 
-enum class MoveType: uint8_t {
-  MOVE=0,
-  CAPTURE=1
+// move struct:
+// 0-5 bit: to position
+// 6-11 bit: from position
+// 12-15 bit: move flag
+enum class MoveFlag: uint8_t {
+  QUIET=0,
+  DOUBLE_PAWN_PUSH=1,
+  KING_CASTLE=2,
+  QUEEN_CASTLE=3,
+  CAPTURE=4,
+  EN_PASSANT=5,
+  KNIGHT_PROMOTION=8,
+  BISHOP_PROMOTION=9,
+  ROOK_PROMOTION=10,
+  QUEEN_PROMOTION=11,
+  KNIGHT_PROMOTION_CAPTURE=12,
+  BISHOP_PROMOTION_CAPTURE=13,
+  ROOK_PROMOTION_CAPTURE=14,
+  QUEEN_PROMOTION_CAPTURE=15
 };
+constexpr uint8_t MOVE_FLAG_SHIFT = 12;
+constexpr uint8_t MOVE_FLAG_CAPTURE_BIT = 4;
+constexpr uint8_t MOVE_FLAG_PROMOTION_BIT = 8;
+constexpr uint8_t MOVE_FLAG_PROMOTION_MASK = 0b11;
+// promotion pieces in move flag order
+constexpr std::array<PieceType,4> PROMOTION_PIECES{PieceType::KNIGHT_PIECE, PieceType::BISHOP_PIECE, PieceType::ROOK_PIECE, PieceType::QUEEN_PIECE};
+
+inline MoveFlag getPromotionFlag(PieceType promotionType, bool isCapture) {
+  uint8_t index = std::find(PROMOTION_PIECES.begin(), PROMOTION_PIECES.end(), promotionType) - PROMOTION_PIECES.begin();
+  assert(index < PROMOTION_PIECES.size());
+  return static_cast<MoveFlag>(MOVE_FLAG_PROMOTION_BIT | (isCapture ? MOVE_FLAG_CAPTURE_BIT : 0) | index);
+}
 
 struct Move {
-  Move(Position from, Position to, MoveType type, PieceType promotionType = PieceType::NO_PIECE){
-    data = (static_cast<uint8_t>(promotionType)<<18) + (static_cast<uint8_t>(type)<<12) + (from.data<<6) + to.data;
+  Move(Position from, Position to, MoveFlag flag = MoveFlag::QUIET){
+    data = (static_cast<uint16_t>(flag) << MOVE_FLAG_SHIFT) | (from.data << 6) | to.data;
   }
   Move():data(0){}
 
-
   Position getFrom() const {
     return Position((data >> 6) & 0b111111);
   }
   Position getTo() const {
     return Position(data & 0b111111);
   }
-  MoveType getMoveType() const {
-    return static_cast<MoveType>((data >> 12) & 0b111111);
+  // from and to positions without the flag
+  uint16_t getFromTo() const {
+    return data & 0xfff;
+  }
+  MoveFlag getFlag() const {
+    return static_cast<MoveFlag>(data >> MOVE_FLAG_SHIFT);
+  }
+  // regular, en passant and promotion captures
+  bool isCapture() const {
+    return (data >> MOVE_FLAG_SHIFT) & MOVE_FLAG_CAPTURE_BIT;
+  }
+  bool isPromotion() const {
+    return (data >> MOVE_FLAG_SHIFT) & MOVE_FLAG_PROMOTION_BIT;
   }
   PieceType getPromotionType() const {
-    return static_cast<PieceType>((data>>18) & 0b111111);
+    return isPromotion() ? PROMOTION_PIECES[(data >> MOVE_FLAG_SHIFT) & MOVE_FLAG_PROMOTION_MASK] : PieceType::NO_PIECE;
   }
   std::string print() const;
 
-  uint32_t data;
+  uint16_t data;
+};
+
+constexpr size_t MAX_MOVES = 256;
+
+// fixed capacity move list that lives on the stack, scores are filled in for move ordering
+struct MoveList {
+  inline void push_back(Move move) {
+    assert(count < MAX_MOVES);
+    moves[count++] = move;
+  }
+  inline size_t size() const {
+    return count;
+  }
+  inline void clear() {
+    count = 0;
+  }
+  inline Move& operator[](size_t index) {
+    return moves[index];
+  }
+  inline const Move& operator[](size_t index) const {
+    return moves[index];
+  }
+  inline Move* begin() {
+    return moves.data();
+  }
+  inline Move* end() {
+    return moves.data() + count;
+  }
+  inline const Move* begin() const {
+    return moves.data();
+  }
+  inline const Move* end() const {
+    return moves.data() + count;
+  }
+
+  std::array<Move, MAX_MOVES> moves;
+  std::array<int16_t, MAX_MOVES> scores;
+  size_t count{0};
+};
+
+// state needed to take back a move made with Board::doMove
+struct UndoRecord {
+  uint64_t hash{0};
+  // castling rights, en passant col and halfmove clock before the move
+  uint16_t gamestate{0};
+  Square movingPiece;
+  Square capturedPiece;
+  // differs from move destination for en passant
+  Position capturedPos{0};
+  // copied back instead of reversing the incremental update
+  std::array<std::array<int8_t,64>,2> attackCount;
 };
 
 struct Board{
@@ -148,7 +264,52 @@ struct Board{
   Board();
   std::string logBoard() const;
   void startingPosition();
-  inline void setSquare(Position pos, Square square) {
+  // position from Forsyth-Edwards Notation, returns false on malformed input
+  bool loadFen(const std::string& fen);
+  // keeps the Zobrist hash, material and piece-square score, game phase, material key, attack counts, bitboards and the network accumulator up to date,
+  // all board changes go through here, attack counts may be skipped when they are restored as a whole
+  inline void setSquare(Position pos, Square square, bool updateAttacks = true) {
+    Square oldSquare = squares[pos.data];
+    if(oldSquare.data == square.data) {
+      return;
+    }
+    Bitboard posBB = squareBB(pos.data);
+    Bitboard occupancy = getOccupancy();
+    Bitboard newOccupancy = square.getPieceType() != PieceType::NO_PIECE ? occupancy | posBB : occupancy & ~posBB;
+    if(oldSquare.getPieceType() != PieceType::NO_PIECE) {
+      if(updateAttacks) {
+        updateAttackCount(oldSquare, pos.data, occupancy, -1);
+      }
+      auto& sidePieces = pieces[static_cast<uint8_t>(getSide(oldSquare.getSideBit()))];
+      sidePieces[static_cast<uint8_t>(oldSquare.getPieceType())] ^= posBB;
+      sidePieces[static_cast<uint8_t>(PieceType::NO_PIECE)] ^= posBB;
+    }
+    if(square.getPieceType() != PieceType::NO_PIECE) {
+      auto& sidePieces = pieces[static_cast<uint8_t>(getSide(square.getSideBit()))];
+      sidePieces[static_cast<uint8_t>(square.getPieceType())] ^= posBB;
+      sidePieces[static_cast<uint8_t>(PieceType::NO_PIECE)] ^= posBB;
+      if(updateAttacks) {
+        updateAttackCount(square, pos.data, newOccupancy, 1);
+      }
+    }
+    // sliders with a ray through the square see further or less far
+    if(updateAttacks && occupancy != newOccupancy) {
+      updateSliderAttackCount(pos.data, occupancy, newOccupancy);
+    }
+    hash ^= ZOBRIST.square[pos.data][oldSquare.data] ^ ZOBRIST.square[pos.data][square.data];
+    if(oldSquare.getPieceType() == PieceType::PAWN_PIECE) {
+      pawnKey ^= ZOBRIST.square[pos.data][oldSquare.data];
+    }
+    if(square.getPieceType() == PieceType::PAWN_PIECE) {
+      pawnKey ^= ZOBRIST.square[pos.data][square.data];
+    }
+    pstScore -= PST[oldSquare.data][pos.data];
+    pstScore += PST[square.data][pos.data];
+    phase += PHASE_WEIGHT[static_cast<uint8_t>(square.getPieceType())] - PHASE_WEIGHT[static_cast<uint8_t>(oldSquare.getPieceType())];
+    materialKey += MATERIAL_KEY_UNIT[square.data] - MATERIAL_KEY_UNIT[oldSquare.data];
+    if(network) {
+      updateAccumulator(oldSquare, square, pos.data);
+    }
     squares[pos.data] = square;
   }
   inline Square getSquare(Position pos) const {
@@ -158,12 +319,25 @@ struct Board{
     return squares[Position(row,col).data];
   }
 
+  inline Bitboard getPieces(Side side, PieceType pieceType) const {
+    return pieces[static_cast<uint8_t>(side)][static_cast<uint8_t>(pieceType)];
+  }
+  inline Bitboard getOccupancy(Side side) const {
+    return pieces[static_cast<uint8_t>(side)][static_cast<uint8_t>(PieceType::NO_PIECE)];
+  }
+  inline Bitboard getOccupancy() const {
+    return getOccupancy(Side::WHITE) | getOccupancy(Side::BLACK);
+  }
+
   inline Side getMovingSide() const {
     WhoseTurnBit whoseSide = static_cast<WhoseTurnBit>(gamestate & WHOSE_TURN_BIT);
     return whoseSide == WhoseTurnBit::WHITE ? Side::WHITE : Side::BLACK;
   }
 
   inline void setMovingSide(Side side) {
+    if(side != getMovingSide()) {
+      hash ^= ZOBRIST.blackToMove;
+    }
     if(side == Side::WHITE) {
       gamestate &= ~(WHOSE_TURN_BIT);
     } else {
@@ -171,9 +345,125 @@ struct Board{
     }
   }
 
+  inline uint8_t getCastlingRights() const {
+    return (gamestate & CASTLING_MASK) >> CASTLING_SHIFT;
+  }
+
+  inline void setCastlingRights(uint8_t castlingRights) {
+    hash ^= ZOBRIST.castling[getCastlingRights()] ^ ZOBRIST.castling[castlingRights];
+    gamestate = (gamestate & ~CASTLING_MASK) | (castlingRights << CASTLING_SHIFT);
+  }
+
+  // col of the pawn that can be captured en passant, NO_COL if none
+  inline int8_t getEnPassantCol() const {
+    return ((gamestate & EN_PASSANT_MASK) >> EN_PASSANT_SHIFT) - 1;
+  }
+
+  inline void setEnPassantCol(int8_t col) {
+    hash ^= ZOBRIST.enPassant[getEnPassantCol() + 1] ^ ZOBRIST.enPassant[col + 1];
+    gamestate = (gamestate & ~EN_PASSANT_MASK) | ((col + 1) << EN_PASSANT_SHIFT);
+  }
+
+  // halfmoves since last capture or pawn move
+  inline uint8_t getHalfmoveClock() const {
+    return (gamestate & HALFMOVE_CLOCK_MASK) >> HALFMOVE_CLOCK_SHIFT;
+  }
+
+  inline void setHalfmoveClock(uint8_t halfmoveClock) {
+    gamestate = (gamestate & ~HALFMOVE_CLOCK_MASK) | (std::min(halfmoveClock, MAX_HALFMOVE_CLOCK) << HALFMOVE_CLOCK_SHIFT);
+  }
+
+  // pieces of bySide attacking pos, sliders see through squares missing from occupancy
+  inline Bitboard getAttackers(uint8_t pos, Side bySide, Bitboard occupancy) const {
+    Bitboard queens = getPieces(bySide, PieceType::QUEEN_PIECE);
+    return (PAWN_ATTACKS[static_cast<uint8_t>(getOpponentSide(bySide))][pos] & getPieces(bySide, PieceType::PAWN_PIECE))
+      | (KNIGHT_ATTACKS[pos] & getPieces(bySide, PieceType::KNIGHT_PIECE))
+      | (KING_ATTACKS[pos] & getPieces(bySide, PieceType::KING_PIECE))
+      | (bishopAttacks(pos, occupancy) & (getPieces(bySide, PieceType::BISHOP_PIECE) | queens))
+      | (rookAttacks(pos, occupancy) & (getPieces(bySide, PieceType::ROOK_PIECE) | queens));
+  }
+
+  inline bool isSquareAttacked(uint8_t pos, Side bySide) const {
+    return getAttackers(pos, bySide, getOccupancy()) != 0;
+  }
+
+  // own pieces that are the only blocker between the own king and an opponent slider
+  inline Bitboard getPinned(Side side, uint8_t kingPos) const {
+    Side opponentSide = getOpponentSide(side);
+    Bitboard occupancy = getOccupancy();
+    Bitboard queens = getPieces(opponentSide, PieceType::QUEEN_PIECE);
+    Bitboard snipers = (rookAttacks(kingPos, 0) & (getPieces(opponentSide, PieceType::ROOK_PIECE) | queens))
+      | (bishopAttacks(kingPos, 0) & (getPieces(opponentSide, PieceType::BISHOP_PIECE) | queens));
+    Bitboard pinned = 0;
+    while(snipers) {
+      Bitboard blockers = BETWEEN[kingPos][popLsb(snipers)] & occupancy;
+      if(blockers && !(blockers & (blockers - 1))) {
+        pinned |= blockers & getOccupancy(side);
+      }
+    }
+    return pinned;
+  }
+
+  inline bool isInCheck(Side side) const {
+    Bitboard kings = getPieces(side, PieceType::KING_PIECE);
+    return kings && isSquareAttacked(lsb(kings), getOpponentSide(side));
+  }
+
+  // full recomputation of the incrementally maintained hash
+  uint64_t computeHash() const;
+  // full recomputation of the incrementally maintained pawn key
+  uint64_t computePawnKey() const;
+  // full recomputation of the incrementally maintained material and piece-square score
+  PstScore computePstScore() const;
+  // full recomputation of the incrementally maintained game phase
+  uint8_t computePhase() const;
+  // full recomputation of the incrementally maintained material key
+  uint64_t computeMaterialKey() const;
+
+  inline uint8_t getMaterialCount(Side side, PieceType pieceType) const {
+    return (materialKey >> getMaterialKeyShift(static_cast<uint8_t>(side), pieceType)) & ((1 << MATERIAL_KEY_BITS) - 1);
+  }
+  // full recomputation of the incrementally maintained attack counts
+  std::array<std::array<int8_t,64>,2> computeAttackCount() const;
+  // full recomputation of the incrementally maintained network accumulator
+  NnueAccumulator computeAccumulator() const;
+
+  // network evaluate uses for this board, nullptr for the hand-written evaluation;
+  // the accumulator is computed here and follows every square change from then on
+  void setNetwork(const NnueNetwork* newNetwork);
+
+  // squares attacked by the piece, pawns attack diagonally forward
+  static inline Bitboard getAttacks(Square square, uint8_t pos, Bitboard occupancy) {
+    switch(square.getPieceType()) {
+      case PieceType::PAWN_PIECE:
+        return PAWN_ATTACKS[static_cast<uint8_t>(getSide(square.getSideBit()))][pos];
+      case PieceType::KNIGHT_PIECE:
+        return KNIGHT_ATTACKS[pos];
+      case PieceType::BISHOP_PIECE:
+        return bishopAttacks(pos, occupancy);
+      case PieceType::ROOK_PIECE:
+        return rookAttacks(pos, occupancy);
+      case PieceType::QUEEN_PIECE:
+        return queenAttacks(pos, occupancy);
+      case PieceType::KING_PIECE:
+        return KING_ATTACKS[pos];
+      default:
+        return 0;
+    }
+  }
+
+  // in-place move, only the changed squares are touched; without updateAttacks (perft) the attack counts are left
+  // as they were, stale until the move is undone the same way
+  template<bool updateAttacks = true>
+  void doMove(Move move, UndoRecord& undo);
+  template<bool updateAttacks = true>
+  void undoMove(Move move, const UndoRecord& undo);
+
+  // UCI move string to move with flags derived from this position
+  Move parseMove(const std::string& move) const;
+
   static Board makeMove(const Board& board, std::string move);
   static Board makeMove(const Board& board, Move move);
-  static Board makeMove(const Board& board, Position fromPos, Position toPos, PieceType promoteType);
 
   static inline Side getSide(SideBit sideBit) {
     return sideBit == SideBit::WHITE ? Side::WHITE : Side::BLACK;
@@ -184,18 +474,87 @@ struct Board{
   static inline int8_t getSideSign(Side side) {
     return side == Side::WHITE ? 1 : -1;
   }
+  static inline Side getOpponentSide(Side side) {
+    return side == Side::WHITE ? Side::BLACK : Side::WHITE;
+  }
 
   std::array<Square,64> squares;
-  uint8_t gamestate{0};
+  // piece bitboards indexed by side and piece type, NO_PIECE index holds all pieces of the side
+  std::array<std::array<Bitboard,7>,2> pieces{};
+  uint16_t gamestate{0};
+  // Zobrist hash of squares, moving side, castling rights and en passant col
+  uint64_t hash{0};
+  // Zobrist hash of the pawn squares only, key of the pawn structure table
+  uint64_t pawnKey{0};
+  // material and piece-square terms of all pieces, follows the squares like the hash
+  PstScore pstScore;
+  // PHASE_WEIGHT sum of the pieces, blends the midgame and endgame halves of the scores
+  uint8_t phase{0};
+  // MATERIAL_KEY_UNIT sum of the pieces, picks the specialized evaluation of known endings
+  uint64_t materialKey{0};
+  // number of pieces of a side attacking or defending a square, indexed by side and position
+  std::array<std::array<int8_t,64>,2> attackCount{};
+  // first network layer by perspective side, kept only while network is set
+  const NnueNetwork* network{nullptr};
+  NnueAccumulator accumulator;
+
+  private:
+  // undone by the reverse square change, int16 sums wrap back exactly
+  inline void updateAccumulator(Square oldSquare, Square square, uint8_t pos) {
+    for(uint8_t perspective=0;perspective<2;perspective++) {
+      if(oldSquare.getPieceType() != PieceType::NO_PIECE) {
+        size_t feature = getNnueFeature(perspective, static_cast<uint8_t>(oldSquare.getPieceType()), static_cast<uint8_t>(getSide(oldSquare.getSideBit())), pos);
+        subNnueFeature(accumulator[perspective], network->getFeatureWeights(feature));
+      }
+      if(square.getPieceType() != PieceType::NO_PIECE) {
+        size_t feature = getNnueFeature(perspective, static_cast<uint8_t>(square.getPieceType()), static_cast<uint8_t>(getSide(square.getSideBit())), pos);
+        addNnueFeature(accumulator[perspective], network->getFeatureWeights(feature));
+      }
+    }
+  }
+
+  inline void updateAttackCount(Square square, uint8_t pos, Bitboard occupancy, int8_t delta) {
+    auto& sideAttackCount = attackCount[static_cast<uint8_t>(getSide(square.getSideBit()))];
+    for(Bitboard attacks = getAttacks(square, pos, occupancy); attacks; ) {
+      sideAttackCount[popLsb(attacks)] += delta;
+    }
+  }
+
+  // only the part of a slider ray behind pos changes
+  inline void updateSliderAttackCount(uint8_t pos, Bitboard occupancy, Bitboard newOccupancy) {
+    Bitboard rookRays = rookAttacks(pos, occupancy);
+    Bitboard bishopRays = bishopAttacks(pos, occupancy);
+    for(Side side : {Side::WHITE, Side::BLACK}) {
+      Bitboard queens = getPieces(side, PieceType::QUEEN_PIECE);
+      Bitboard sliders = (rookRays & (getPieces(side, PieceType::ROOK_PIECE) | queens))
+        | (bishopRays & (getPieces(side, PieceType::BISHOP_PIECE) | queens));
+      auto& sideAttackCount = attackCount[static_cast<uint8_t>(side)];
+      while(sliders) {
+        uint8_t sliderPos = popLsb(sliders);
+        Square slider = squares[sliderPos];
+        Bitboard attacks = getAttacks(slider, sliderPos, occupancy);
+        Bitboard newAttacks = getAttacks(slider, sliderPos, newOccupancy);
+        for(Bitboard removed = attacks & ~newAttacks; removed; ) {
+          sideAttackCount[popLsb(removed)] -= 1;
+        }
+        for(Bitboard added = newAttacks & ~attacks; added; ) {
+          sideAttackCount[popLsb(added)] += 1;
+        }
+      }
+    }
+  }
 };
 
 inline bool operator==(const Board& lhs, const Board& rhs){
+  if(lhs.hash != rhs.hash) {
+    return false;
+  }
   for(int i=0;i<lhs.squares.size();i++) {
     if(lhs.squares[i].data!=rhs.squares[i].data) {
       return false;
     }
   }
-  return lhs.gamestate == rhs.gamestate;
+  return (lhs.gamestate & ~HALFMOVE_CLOCK_MASK) == (rhs.gamestate & ~HALFMOVE_CLOCK_MASK);
 }
 
 template <class T>
@@ -206,17 +565,7 @@ struct Hasher<Board>
 {
     std::size_t operator()(const Board& board) const 
     {
-      size_t res = 0;
-      for(int i=0;i<board.squares.size();i+=4) {
-        res^= (size_t)board.squares[i].data
-          + (((size_t)board.squares[i+1].data)<<8)
-          + (((size_t)board.squares[i+2].data)<<16) 
-          + (((size_t)board.squares[i+3].data)<<24)
-          + 0x9e3779b9 + (res<< 6) + (res>> 2);
-      }
-      
-      res += board.gamestate;
-      return res;
+      return board.hash;
     }
 };
 
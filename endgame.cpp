@@ -0,0 +1,178 @@
+#include "endgame.h"
+
+#include <algorithm>
+
+#include "eval.h"
+#include "kpk.h"
+
+namespace chesseng {
+namespace {
+constexpr uint64_t materialOf(Side side, PieceType pieceType, uint8_t count = 1) {
+  return static_cast<uint64_t>(count) << getMaterialKeyShift(static_cast<uint8_t>(side), pieceType);
+}
+
+// all counts of a piece type, both sides
+constexpr uint64_t materialMask(PieceType pieceType) {
+  return materialOf(Side::WHITE, pieceType, 0b1111) | materialOf(Side::BLACK, pieceType, 0b1111);
+}
+
+constexpr uint64_t PAWNS_ROOKS_QUEENS_MASK = materialMask(PieceType::PAWN_PIECE) | materialMask(PieceType::ROOK_PIECE) | materialMask(PieceType::QUEEN_PIECE);
+
+// opposite coloured bishops are drawish even a few pawns up
+constexpr uint8_t OPPOSITE_BISHOPS_SCALE = 24;
+// no pawns left to promote and at most a minor piece ahead
+constexpr uint8_t NO_PAWNS_MINOR_LEAD_SCALE = 8;
+
+// gradients towards the mate: weak king to the edge, strong king next to it
+constexpr int16_t EDGE_BONUS = 20;
+constexpr int16_t KINGS_CLOSE_BONUS = 10;
+constexpr int16_t CORNER_BONUS = 25;
+// pawn progress of a won KPK
+constexpr int16_t KPK_ROW_BONUS = 20;
+constexpr int16_t SCORE_LIMIT = AFTER_CHECKMATE_SCORE/2 - 1;
+
+inline uint64_t getSideMaterial(uint64_t materialKey, Side side) {
+  return (materialKey >> (static_cast<uint8_t>(side)*MATERIAL_KEY_SIDE_SHIFT)) & MATERIAL_KEY_SIDE_MASK;
+}
+
+inline uint64_t getSideMaterial(uint64_t materialKey, Side side, Side asSide) {
+  return getSideMaterial(materialKey, side) << (static_cast<uint8_t>(asSide)*MATERIAL_KEY_SIDE_SHIFT);
+}
+
+inline uint8_t getKingPos(const Board& board, Side side) {
+  return lsb(board.getPieces(side, PieceType::KING_PIECE));
+}
+
+// rows and cols away from the four centre squares, 0 to 6
+inline int16_t getCenterDistance(uint8_t pos) {
+  int16_t row = pos >> 3;
+  int16_t col = pos & 0b111;
+  return std::max<int16_t>(3 - row, row - 4) + std::max<int16_t>(3 - col, col - 4);
+}
+
+int16_t getNonPawnMaterial(const Board& board, Side side) {
+  int16_t material = 0;
+  for(PieceType pieceType : {PieceType::ROOK_PIECE, PieceType::KNIGHT_PIECE, PieceType::BISHOP_PIECE, PieceType::QUEEN_PIECE}) {
+    material += board.getMaterialCount(side, pieceType)*MG_PIECE_VALUE[static_cast<uint8_t>(pieceType)];
+  }
+  return material;
+}
+
+int16_t getMaterial(const Board& board, Side side) {
+  int16_t material = 0;
+  for(uint8_t pieceType=1;pieceType<6;pieceType++) {
+    material += board.getMaterialCount(side, static_cast<PieceType>(pieceType))*EG_PIECE_VALUE[pieceType];
+  }
+  return material;
+}
+
+inline int16_t toWhite(int32_t score, Side strongSide) {
+  return std::min<int32_t>(score, SCORE_LIMIT)*Board::getSideSign(strongSide);
+}
+
+// mating material against a bare king: the weak king is driven to the edge
+int16_t evaluateKXK(const Board& board, Side strongSide) {
+  uint8_t strongKing = getKingPos(board, strongSide);
+  uint8_t weakKing = getKingPos(board, Board::getOpponentSide(strongSide));
+  int32_t score = KNOWN_WIN_SCORE + getMaterial(board, strongSide)
+    + getCenterDistance(weakKing)*EDGE_BONUS + (7 - getDistance(strongKing, weakKing))*KINGS_CLOSE_BONUS;
+  return toWhite(score, strongSide);
+}
+
+// bishop and knight: only the corners of the bishop's colour can be mated in
+int16_t evaluateKBNK(const Board& board, Side strongSide) {
+  uint8_t strongKing = getKingPos(board, strongSide);
+  uint8_t weakKing = getKingPos(board, Board::getOpponentSide(strongSide));
+  bool darkBishop = board.getPieces(strongSide, PieceType::BISHOP_PIECE) & DARK_SQUARES_BB;
+  uint8_t cornerDistance = darkBishop ? std::min(getDistance(weakKing, 0), getDistance(weakKing, 63)) : std::min(getDistance(weakKing, 7), getDistance(weakKing, 56));
+  int32_t score = KNOWN_WIN_SCORE + getMaterial(board, strongSide)
+    + (7 - cornerDistance)*CORNER_BONUS + (7 - getDistance(strongKing, weakKing))*KINGS_CLOSE_BONUS;
+  return toWhite(score, strongSide);
+}
+
+// king and pawn against king won according to the bitbase, closer to the promotion is better
+int16_t evaluateKPK(const Board& board, Side strongSide) {
+  uint8_t flip = strongSide == Side::WHITE ? 0 : 0b111000;
+  uint8_t pawn = lsb(board.getPieces(strongSide, PieceType::PAWN_PIECE)) ^ flip;
+  uint8_t strongKing = getKingPos(board, strongSide) ^ flip;
+  uint8_t promotion = 56 + (pawn & 0b111);
+  int32_t score = KNOWN_WIN_SCORE + EG_PIECE_VALUE[static_cast<uint8_t>(PieceType::PAWN_PIECE)] + (pawn >> 3)*KPK_ROW_BONUS - getDistance(strongKing, promotion);
+  return toWhite(score, strongSide);
+}
+}
+
+bool isKnownDraw(const Board& board) {
+  uint64_t materialKey = board.materialKey;
+  for(Side side : {Side::WHITE, Side::BLACK}) {
+    if(materialKey == materialOf(side, PieceType::PAWN_PIECE)) {
+      return getKpkBitbase().isReady() && !getKpkBitbase().probe(board, side);
+    }
+  }
+  if(materialKey & PAWNS_ROOKS_QUEENS_MASK) {
+    return false;
+  }
+  std::array<uint8_t, 2> minors;
+  std::array<uint8_t, 2> knights;
+  for(Side side : {Side::WHITE, Side::BLACK}) {
+    knights[static_cast<uint8_t>(side)] = board.getMaterialCount(side, PieceType::KNIGHT_PIECE);
+    minors[static_cast<uint8_t>(side)] = knights[static_cast<uint8_t>(side)] + board.getMaterialCount(side, PieceType::BISHOP_PIECE);
+  }
+  if(minors[0] <= 1 && minors[1] <= 1) {
+    return true;
+  }
+  // two knights cannot force a mate
+  return (minors[0] == 0 && knights[1] == 2 && minors[1] == 2) || (minors[1] == 0 && knights[0] == 2 && minors[0] == 2);
+}
+
+bool evaluateEndgame(const Board& board, int16_t& score) {
+  if(isKnownDraw(board)) {
+    score = 0;
+    return true;
+  }
+  uint64_t materialKey = board.materialKey;
+  for(Side strongSide : {Side::WHITE, Side::BLACK}) {
+    Side weakSide = Board::getOpponentSide(strongSide);
+    if(getSideMaterial(materialKey, weakSide)) {
+      continue;
+    }
+    // signatures are compared as if white was the strong side
+    uint64_t strongMaterial = getSideMaterial(materialKey, strongSide, Side::WHITE);
+    // drawn ones are known draws already
+    if(strongMaterial == materialOf(Side::WHITE, PieceType::PAWN_PIECE) && getKpkBitbase().isReady()) {
+      score = evaluateKPK(board, strongSide);
+      return true;
+    }
+    if(strongMaterial == (materialOf(Side::WHITE, PieceType::BISHOP_PIECE) | materialOf(Side::WHITE, PieceType::KNIGHT_PIECE))) {
+      score = evaluateKBNK(board, strongSide);
+      return true;
+    }
+    Bitboard bishops = board.getPieces(strongSide, PieceType::BISHOP_PIECE);
+    bool bishopPair = (bishops & DARK_SQUARES_BB) && (bishops & ~DARK_SQUARES_BB);
+    if(board.getMaterialCount(strongSide, PieceType::ROOK_PIECE) || board.getMaterialCount(strongSide, PieceType::QUEEN_PIECE) || bishopPair) {
+      score = evaluateKXK(board, strongSide);
+      return true;
+    }
+    return false;
+  }
+  return false;
+}
+
+uint8_t getEndgameScale(const Board& board, Side strongSide) {
+  Side weakSide = Board::getOpponentSide(strongSide);
+  uint64_t bishopsOnly = materialOf(Side::WHITE, PieceType::BISHOP_PIECE) | materialOf(Side::BLACK, PieceType::BISHOP_PIECE);
+  if((board.materialKey & ~materialMask(PieceType::PAWN_PIECE)) == bishopsOnly) {
+    Bitboard whiteBishop = board.getPieces(Side::WHITE, PieceType::BISHOP_PIECE);
+    Bitboard blackBishop = board.getPieces(Side::BLACK, PieceType::BISHOP_PIECE);
+    if(!(whiteBishop & DARK_SQUARES_BB) != !(blackBishop & DARK_SQUARES_BB)) {
+      return OPPOSITE_BISHOPS_SCALE;
+    }
+  }
+  int16_t strongMaterial = getNonPawnMaterial(board, strongSide);
+  if(!board.getMaterialCount(strongSide, PieceType::PAWN_PIECE) && strongMaterial > 0
+    && strongMaterial - getNonPawnMaterial(board, weakSide) <= MG_PIECE_VALUE[static_cast<uint8_t>(PieceType::BISHOP_PIECE)]) {
+    return NO_PAWNS_MINOR_LEAD_SCALE;
+  }
+  return ENDGAME_SCALE_NORMAL;
+}
+
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+
+#include "board.h"
+
+namespace chesseng {
+
+// known endings are looked up only up to this game phase, enough for a queen and a rook
+constexpr uint8_t ENDGAME_MAX_PHASE = 6;
+
+// base of won endings, the specialized scores stay below half of AFTER_CHECKMATE_SCORE so they are not taken for mates
+constexpr int16_t KNOWN_WIN_SCORE = 2000;
+
+// multiplier of the generic score, out of ENDGAME_SCALE_NORMAL
+constexpr uint8_t ENDGAME_SCALE_NORMAL = 64;
+
+// no side can force a mate: bare kings, one minor piece each at most, two knights against a bare king,
+// king and pawn against king drawn according to the KPK bitbase once it is initialized
+bool isKnownDraw(const Board& board);
+
+// specialized evaluation of a known ending picked by the material key, white perspective,
+// false if the material has none
+bool evaluateEndgame(const Board& board, int16_t& score);
+
+// multiplier of the generic score for drawish endings where strongSide is ahead, ENDGAME_SCALE_NORMAL otherwise
+uint8_t getEndgameScale(const Board& board, Side strongSide);
+
+}
@@ -1,536 +1,178 @@
 #include "engine.h"
 
+#include <algorithm>
 #include <assert.h>
+#include <mutex>
 #include <unordered_set>
 #include <sstream>
+#include <thread>
+
+#include "endgame.h"
+#include "eval.h"
+#include "movegen.h"
+#include "pawns.h"
+#include "workpool.h"
 
 #define SORT_MOVES 1
+// null windows after the first move of a node
+#define PV_SEARCH 1
 
 namespace chesseng {
 namespace {
-constexpr int32_t MAX_DEPTH = 6;
-constexpr int32_t TRIM_TABLE_SIZE = 10000*1000;
-
-constexpr int16_t PAWN_BONUS = 100;
-constexpr int16_t ROOK_BONUS = 500;
-constexpr int16_t KNIGHT_BONUS = 300;
-constexpr int16_t BISHOP_BONUS = 300;
-constexpr int16_t QUEEN_BONUS = 900;
-constexpr int16_t KING_BONUS = 20000;
-
-constexpr int16_t CAN_MOVE_BONUS = 5;
-constexpr int16_t CENTER_BONUS = 20;
-constexpr int16_t NEAR_CENTER_BONUS = 10;
-constexpr int16_t PAWN_ROW_PROGRESS_BONUS = 20;
-constexpr int16_t UNDEFENDED_PIECE_PENALTY_WITH_ATTACKERS = -75;
-constexpr int16_t UNDEFENDED_PIECE_PENALTY_NO_ATTACKERS = -50;
-constexpr int16_t NO_ATTACKERS_HAVE_DEFENDERS_BONUS = 20;
-constexpr int16_t CHECK_PENALTY = -100;
+// iterative deepening ends here, also for a go depth; an infinite search then waits for stop or ponderhit
+constexpr int16_t MAX_ITERATIVE_DEPTH = 64;
+// wait of a finished infinite search
+constexpr int32_t INFINITE_SEARCH_POLL_MS = 1;
+
 constexpr int16_t DISTANT_CHECKMATE_DECAY = -5;
 
 constexpr int16_t STALEMATE_SCORE = -300;
-constexpr int16_t AFTER_CHECKMATE_SCORE = 10000;
+// mated side to move, one ply of mate distance decay from the position with the king capture
+constexpr int16_t CHECKMATE_SCORE = AFTER_CHECKMATE_SCORE + DISTANT_CHECKMATE_DECAY;
 constexpr int8_t EXACT_EVAL_DEPTH = 100;
+// positional terms left out of evaluateMaterialPst stay within this margin
+constexpr int16_t LAZY_EVAL_MARGIN = 500;
 
-struct HeuristicsContext {
-  HeuristicsContext(){
-    whiteAttackCount.fill(0);
-    blackAttackCount.fill(0);
-  }
-
-  std::array<int8_t, 64> whiteAttackCount;
-  std::array<int8_t, 64> blackAttackCount;
-};
+// remaining depth of a node whose moves may be split between threads, shallower subtrees cost less than the split
+constexpr int16_t SPLIT_MIN_DEPTH = 2;
 
-inline void countAttackerDefender(HeuristicsContext& evalContext, Position movePosition, Side pieceSide) {
-  if(pieceSide == Side::WHITE) {
-    evalContext.whiteAttackCount[movePosition.data] += 1;
-  } else {
-    evalContext.blackAttackCount[movePosition.data] += 1;
-  }
+void setExactScore(EvalRecord& record, int16_t score) {
+  record.score=score;
+  record.evalStatus = EvalStatus::DONE_COMPLETE;
+  record.evalDepth = EXACT_EVAL_DEPTH;
 }
 
-inline void evaluateRayMove(const Board& board, HeuristicsContext& evalContext, Position fromPosition, int8_t moveRow, int8_t moveCol, EvalRecord& record, bool& rayEnds) {
-  if(!rowcolok(moveRow) || !rowcolok(moveCol)) {
-    rayEnds=true;
-    return;
+// takes the score of a move into the node's best score and alpha, true on a cutoff (fail soft, the best score is the result)
+inline bool updateWindow(int16_t score, Move move, int16_t& newScore, Move& bestMove, int16_t& alpha, int16_t beta) {
+  if(newScore < score) {
+    newScore = score;
+    bestMove = move;
   }
-
-  Position movePosition = Position(moveRow, moveCol);
-  Square square = board.getSquare(fromPosition);
-  Side pieceSide = Board::getSide(square.getSideBit());
-  int8_t pieceSign = Board::getSideSign(pieceSide);
-  Square moveSquare = board.getSquare(movePosition);
-  PieceType movePieceType = moveSquare.getPieceType();
-  Side movePieceSide = Board::getSide(moveSquare.getSideBit());
-  if(movePieceType == PieceType::NO_PIECE || movePieceSide != pieceSide) {
-    // move valid
-    record.score+=CAN_MOVE_BONUS*pieceSign;
-
-    // register move
-    if(pieceSide == board.getMovingSide()) {
-      record.moves.push_back(Move(fromPosition,movePosition, movePieceType==PieceType::NO_PIECE ? MoveType::MOVE : MoveType::CAPTURE));
-    }
+  if(newScore >= beta) {
+    return true;
   }
-
-  // count attackers, defenders
-  countAttackerDefender(evalContext, movePosition, pieceSide);
-  
-
-  // ray ends on first not-empty square
-  if(movePieceType != PieceType::NO_PIECE) {
-    rayEnds=true;
+  if(newScore > alpha) {
+    alpha = newScore;
   }
+  return false;
 }
 
-void setExactScore(EvalRecord& record, int16_t score) {
-  record.score=score;
-  record.evalStatus = EvalStatus::DONE_COMPLETE;
-  record.evalDepth = EXACT_EVAL_DEPTH;
-}
+// the search scores for the side to move, the table from white's view
+inline BoundType getLowerBound(Side movingSide) {
+  return movingSide == Side::WHITE ? BoundType::LOWER : BoundType::UPPER;
 }
 
-EvalRecord Engine::evaluateBoard(const Board& board) {
-  EvalRecord record;
-  record.moves.reserve(40);
-  Side movingSide = board.getMovingSide();
-  int8_t movingSideSign = Board::getSideSign(movingSide);
-  SideBit movingSideBit = Board::getSideBit(movingSide);
-  HeuristicsContext evalContext;
-  
-  std::array<Side,2> sideEvalOrder{Side::BLACK,Side::WHITE};
-  if(movingSide == Side::BLACK) {
-    sideEvalOrder = {Side::WHITE, Side::BLACK};
-  }
-
-  for(Side evalSide : sideEvalOrder) {
-    for(size_t posIndex=0;posIndex<64;posIndex++) {
-      Position pos(posIndex);
-      Square square = board.getSquare(pos);
-      PieceType pieceType = square.getPieceType();
-      if(pieceType == PieceType::NO_PIECE) {
-        continue;
-      }
-      SideBit pieceSideBit = square.getSideBit();
-      Side pieceSide = Board::getSide(pieceSideBit);
-      if(pieceSide != evalSide) {
-        continue;
-      }
-      int8_t pieceSign = Board::getSideSign(pieceSide);
-      int8_t row=pos.getRow();
-      int8_t col=pos.getCol();
-
-      if(square.getPieceType() == PieceType::PAWN_PIECE) {
-        // PAWN
-        // piece eval
-        record.score+=PAWN_BONUS*pieceSign;
-
-        int8_t pawnRowProgress = (pieceSide==Side::WHITE) ? row-1 : 6-row;
-        record.score+=pawnRowProgress*PAWN_ROW_PROGRESS_BONUS*pieceSign;
-
-        // moves eval
-        int8_t forwardMoveRow = row + pieceSign;
-        if(rowcolok(forwardMoveRow)) {
-          Square forwardMoveSquare = board.getSquare(forwardMoveRow,col);
-          if(forwardMoveSquare.getPieceType()==PieceType::NO_PIECE) {
-            // forward move is valid
-            record.score+=CAN_MOVE_BONUS*pieceSign;
-
-            // TODO: blocked pawn penalty
-
-            // register move
-            if(square.getSideBit() == movingSideBit) {
-              bool promotionPossible = (pieceSide == Side::WHITE && forwardMoveRow==7) || (pieceSide == Side::BLACK && forwardMoveRow == 0);
-              record.moves.push_back(Move(pos,Position(forwardMoveRow,col), MoveType::MOVE, promotionPossible ? PieceType::QUEEN_PIECE : PieceType::NO_PIECE));
-            }
-
-          }
-        }
-
-        int8_t twiceForwardStartingRow = pieceSide == Side::WHITE ? 1 : 6;
-        int8_t twiceForwardMoveRow = row +2*pieceSign;
-        if(row==twiceForwardStartingRow && rowcolok(twiceForwardMoveRow)) {
-          Square forwardMoveSquare = board.getSquare(forwardMoveRow,col);
-          Square twiceForwardMoveSquare = board.getSquare(twiceForwardMoveRow,col);
-          if(forwardMoveSquare.getPieceType()==PieceType::NO_PIECE && twiceForwardMoveSquare.getPieceType()==PieceType::NO_PIECE) {
-            // twice forward move is valid
-            record.score+=CAN_MOVE_BONUS*pieceSign;
-
-            // register move
-            if(square.getSideBit() == movingSideBit) {
-              record.moves.push_back(Move(pos,Position(twiceForwardMoveRow,col), MoveType::MOVE));
-            }
-          }
-        }
-
-        for(int8_t colshift =-1;colshift<=1;colshift+=2){
-          int8_t takesCol = col+colshift;
-          if(rowcolok(takesCol)) {
-            // regular capture
-            {
-              Position takesPos = Position(forwardMoveRow,takesCol);
-              Square takesSquare = board.getSquare(takesPos);
-              Side movePieceSide = Board::getSide(takesSquare.getSideBit());
-              if(takesSquare.getPieceType()!=PieceType::NO_PIECE && takesSquare.getSideBit()!=pieceSideBit) {
-                // move is valid
-                record.score+=CAN_MOVE_BONUS*pieceSign;
-
-                // register capture move
-                if(square.getSideBit() == movingSideBit) {
-                  bool promotionPossible = (pieceSide == Side::WHITE && forwardMoveRow==7) || (pieceSide == Side::BLACK && forwardMoveRow == 0);
-                  record.moves.push_back(Move(pos,takesPos, MoveType::CAPTURE, promotionPossible ? PieceType::QUEEN_PIECE : PieceType::NO_PIECE));
-                }
-              }
-
-              // count attackers, defenders
-              countAttackerDefender(evalContext, takesPos, pieceSide);
-            }
-            // en passant capture
-            {
-              Position enpassantPawnPos = Position(row,takesCol);
-              Square maybePawnSquare = board.getSquare(enpassantPawnPos);
-              if(maybePawnSquare.getPieceType()==PieceType::PAWN_PIECE 
-                && maybePawnSquare.getSideBit()!=pieceSideBit 
-                && maybePawnSquare.getPawnMovedTwiceBit()==PawnMovedTwiceBit::YES) {
-                  // move is valid
-                  record.score+=CAN_MOVE_BONUS*pieceSign;
-                  Position movePosition = Position(forwardMoveRow,takesCol);
-                  record.moves.push_back(Move(pos,movePosition, MoveType::CAPTURE));
-                }
-            }
-          }
-        }
-
-        
-      } else if(square.getPieceType() == PieceType::ROOK_PIECE) {
-        // ROOK
-        // piece eval
-        record.score += ROOK_BONUS*pieceSign;
-
-        // moves eval
-        bool rayEnds=false;
-        for(int8_t moveRow = row+1;moveRow<8 && !rayEnds;moveRow++) {
-          evaluateRayMove(board, evalContext, pos, moveRow, col, record, rayEnds);
-        }
-        rayEnds=false;
-        for(int8_t moveRow = row-1;moveRow>=0 && !rayEnds;moveRow--) {
-          evaluateRayMove(board, evalContext, pos, moveRow, col, record, rayEnds);
-        }
-        rayEnds=false;
-        for(int8_t moveCol = col+1;moveCol<8 && !rayEnds;moveCol++) {
-          evaluateRayMove(board, evalContext, pos, row, moveCol, record, rayEnds);
-        }
-        rayEnds=false;
-        for(int8_t moveCol = col-1;moveCol>=0 && !rayEnds;moveCol--) {
-          evaluateRayMove(board, evalContext, pos, row, moveCol, record, rayEnds);
-        }
-      } else if(square.getPieceType() == PieceType::BISHOP_PIECE) {
-        // BISHOP
-        // piece eval
-        record.score += BISHOP_BONUS*pieceSign;
-
-        // moves eval
-        bool rayEnds=false;
-        for(int8_t moveRow = row+1;moveRow<8 && !rayEnds;moveRow++) {
-          int8_t moveCol = col + (moveRow-row);
-          evaluateRayMove(board, evalContext, pos, moveRow, moveCol, record, rayEnds);
-        }
-        rayEnds=false;
-        for(int8_t moveRow = row+1;moveRow<8 && !rayEnds;moveRow++) {
-          int8_t moveCol = col + (row-moveRow);
-          evaluateRayMove(board, evalContext, pos, moveRow, moveCol, record, rayEnds);
-        }
-        rayEnds=false;
-        for(int8_t moveRow = row-1;moveRow>=0 && !rayEnds;moveRow--) {
-          int8_t moveCol = col + (moveRow-row);
-          evaluateRayMove(board, evalContext, pos, moveRow, moveCol, record, rayEnds);
-        }
-        rayEnds=false;
-        for(int8_t moveRow = row-1;moveRow>=0 && !rayEnds;moveRow--) {
-          int8_t moveCol = col + (row-moveRow);
-          evaluateRayMove(board, evalContext, pos, moveRow, moveCol, record, rayEnds);
-        }
-      } else if(square.getPieceType() == PieceType::QUEEN_PIECE) {
-        // QUEEN
-        // piece eval
-        record.score += QUEEN_BONUS*pieceSign;
-
-        // moves eval
-        // rook-like
-        bool rayEnds=false;
-        for(int8_t moveRow = row+1;moveRow<8 && !rayEnds;moveRow++) {
-          evaluateRayMove(board, evalContext, pos, moveRow, col, record, rayEnds);
-        }
-        rayEnds=false;
-        for(int8_t moveRow = row-1;moveRow>=0 && !rayEnds;moveRow--) {
-          evaluateRayMove(board, evalContext, pos, moveRow, col, record, rayEnds);
-        }
-        rayEnds=false;
-        for(int8_t moveCol = col+1;moveCol<8 && !rayEnds;moveCol++) {
-          evaluateRayMove(board, evalContext, pos, row, moveCol, record, rayEnds);
-        }
-        rayEnds=false;
-        for(int8_t moveCol = col-1;moveCol>=0 && !rayEnds;moveCol--) {
-          evaluateRayMove(board, evalContext, pos, row, moveCol, record, rayEnds);
-        }
-        // bishop-like
-        rayEnds=false;
-        for(int8_t moveRow = row+1;moveRow<8 && !rayEnds;moveRow++) {
-          int8_t moveCol = col + (moveRow-row);
-          evaluateRayMove(board, evalContext, pos, moveRow, moveCol, record, rayEnds);
-        }
-        rayEnds=false;
-        for(int8_t moveRow = row+1;moveRow<8 && !rayEnds;moveRow++) {
-          int8_t moveCol = col + (row-moveRow);
-          evaluateRayMove(board, evalContext, pos, moveRow, moveCol, record, rayEnds);
-        }
-        rayEnds=false;
-        for(int8_t moveRow = row-1;moveRow>=0 && !rayEnds;moveRow--) {
-          int8_t moveCol = col + (moveRow-row);
-          evaluateRayMove(board, evalContext, pos, moveRow, moveCol, record, rayEnds);
-        }
-        rayEnds=false;
-        for(int8_t moveRow = row-1;moveRow>=0 && !rayEnds;moveRow--) {
-          int8_t moveCol = col + (row-moveRow);
-          evaluateRayMove(board, evalContext, pos, moveRow, moveCol, record, rayEnds);
-        }
-      } else if(square.getPieceType() == PieceType::KNIGHT_PIECE) {
-        // KNIGHT
-        // piece eval
-        record.score += KNIGHT_BONUS*pieceSign;
-        
-        // moves eval
-        static std::array<std::pair<int8_t,int8_t>,8> knightDeltas = {std::pair<int8_t,int8_t>{-2,-1},{-2,1},{-1,-2},{-1,2},{1,-2},{1,2},{2,-1},{2,1}};
-        bool dummyRayEnds = false;
-        for(const auto& deltaPair : knightDeltas) {
-          evaluateRayMove(board, evalContext, pos, row+deltaPair.first, col+deltaPair.second, record, dummyRayEnds);
-        }
-      } else if(square.getPieceType() == PieceType::KING_PIECE) {
-        // KING
-        // piece eval
-        record.score += KING_BONUS*pieceSign;
-
-        // moves eval
-        for(int8_t rowDelta = -1; rowDelta<=1; rowDelta++) {
-          for(int8_t colDelta = -1; colDelta<=1; colDelta++) {
-            if(colDelta==0 && rowDelta==0) {
-              continue;
-            }
-
-            if(!rowcolok(row+rowDelta) || !rowcolok(col+colDelta)) {
-              continue;
-            }
-
-            Position movePos = Position(row+rowDelta, col+colDelta);
-            Square moveSquare = board.getSquare(movePos);
-            PieceType movePieceType = moveSquare.getPieceType();
-            Side movePieceSide = Board::getSide(moveSquare.getSideBit());
-            if(movePieceType == PieceType::NO_PIECE || movePieceSide != pieceSide) {             
-              int8_t moveSquareAttackerCount = pieceSide == Side::WHITE ? evalContext.blackAttackCount[movePos.data] : evalContext.whiteAttackCount[movePos.data];
-              if(moveSquareAttackerCount > 0) {
-                // move to attacked square is invalid
-                continue;
-              }
-
-              // move is valid
-              record.score+=CAN_MOVE_BONUS*pieceSign;
-
-              // register move
-              if(pieceSide == board.getMovingSide()) {
-                record.moves.push_back(Move(pos,movePos, movePieceType==PieceType::NO_PIECE ? MoveType::MOVE : MoveType::CAPTURE));
-              }  
-            }
-
-            // count attackers, defenders
-            countAttackerDefender(evalContext, movePos, pieceSide);
-          }
-        }
-
-        // TODO: castling
-        if(pos.getCol() == 4 && square.getMovedBit() == MovedBit::NO) {
-          int8_t attackerCount =  pieceSide == Side::WHITE ? evalContext.blackAttackCount[pos.data] : evalContext.whiteAttackCount[pos.data];
-          if(attackerCount ==0) {
-            // short castling
-            {
-              Square expectRook = board.getSquare(row, 7);
-              if(expectRook.getPieceType()==PieceType::ROOK_PIECE && expectRook.getMovedBit()==MovedBit::NO) {
-                bool valid=true;
-                for(int middleCol=5;middleCol<=6;middleCol++) {
-                  Position middlePos = Position(row, middleCol);
-                  int8_t attackerCount =  pieceSide == Side::WHITE ? evalContext.blackAttackCount[middlePos.data] : evalContext.whiteAttackCount[middlePos.data];
-                  valid&=(board.getSquare(middlePos).getPieceType() == PieceType::NO_PIECE) && attackerCount==0;
-                }
-
-                if(valid) {
-                  // move is valid
-                  record.score+=CAN_MOVE_BONUS*pieceSign;
-                  // register move
-                  if(pieceSide == board.getMovingSide()) {
-                    record.moves.push_back(Move(pos,Position(row, 6), MoveType::MOVE));
-                  }  
-                }
-              }  
-            }
-            // long castling
-            {
-              Square expectRook = board.getSquare(row, 0);
-              if(expectRook.getPieceType()==PieceType::ROOK_PIECE && expectRook.getMovedBit()==MovedBit::NO) {
-                bool valid=true;
-                for(int middleCol=1;middleCol<=3;middleCol++) {
-                  Position middlePos = Position(row, middleCol);
-                  int8_t attackerCount =  pieceSide == Side::WHITE ? evalContext.blackAttackCount[middlePos.data] : evalContext.whiteAttackCount[middlePos.data];
-                  valid&=(board.getSquare(middlePos).getPieceType() == PieceType::NO_PIECE) && attackerCount==0;
-                }
-
-                if(valid) {
-                  // move is valid
-                  record.score+=CAN_MOVE_BONUS*pieceSign;
-                  // register move
-                  if(pieceSide == board.getMovingSide()) {
-                    record.moves.push_back(Move(pos,Position(row, 2), MoveType::MOVE));
-                  }  
-                }
-              }  
-            }
-            
-          }
-        }
-
-      }
+inline BoundType getUpperBound(Side movingSide) {
+  return movingSide == Side::WHITE ? BoundType::UPPER : BoundType::LOWER;
+}
+}
 
-      // piece in center bonus
-      if((row == 3 || row == 4)&&(col == 3 || col == 4)) {
-        record.score+=CENTER_BONUS*pieceSign;
-      } else if(row>=2 && row<=5 && col>=2 && col<=5) {
-        record.score+=NEAR_CENTER_BONUS*pieceSign;
+// a node whose remaining moves are searched by its owner and pool workers, lives on the owner's stack until all its tasks are done
+struct SplitPoint {
+  const SplitPoint* parent{nullptr};
+  Board board;
+  MoveList moves;
+  std::vector<uint64_t> searchPath;
+  int16_t toDepth{0};
+  int16_t toQsDepth{0};
+  bool inCheck{false};
+  std::atomic<size_t> nextMove{0};
+  // queued or running tasks
+  std::atomic<size_t> pendingTasks{0};
+  std::atomic<bool> cutoff{false};
+  // timeout, or a cutoff above
+  std::atomic<bool> aborted{false};
+
+  // the node's beta does not change
+  int16_t beta{0};
+  std::mutex mutex;
+  int16_t newScore{0};
+  Move bestMove;
+  int16_t alpha{0};
+  Move cutoffMove;
+
+  // this or an enclosing split point does not need its result any more
+  bool isCancelled() const {
+    for(const SplitPoint* splitPoint=this;splitPoint;splitPoint=splitPoint->parent) {
+      if(splitPoint->cutoff.load(std::memory_order_relaxed) || splitPoint->aborted.load(std::memory_order_relaxed)) {
+        return true;
       }
     }
+    return false;
   }
+};
 
-  // attacker count eval
-  for(size_t posIndex=0;posIndex<64;posIndex++) {    
-    Square square = board.getSquare(Position(posIndex));
-    PieceType pieceType = square.getPieceType();
-    Side pieceSide = Board::getSide(square.getSideBit());
-    int8_t pieceSign = Board::getSideSign(pieceSide);
-    if(pieceType==PieceType::NO_PIECE) {
-      continue;
+// pool and per worker contexts of one split point search, worker 0 is the main thread with its own context;
+// workers stop on the main context's stop flag and hard limit, their clocks start with it
+struct SplitSearch {
+  SplitSearch(size_t threads, const EvalContext& mainContext): contexts(threads, EvalContext(true, mainContext.hardLimitMs, mainContext.depthRequired)), pool(threads) {
+    for(size_t i=0;i<contexts.size();i++) {
+      contexts[i].workerIndex = i;
+      contexts[i].reportProgress = false;
+      contexts[i].stopSearch = mainContext.stopSearch;
+      contexts[i].infiniteSearch = mainContext.infiniteSearch;
     }
-    int8_t whiteAC = evalContext.whiteAttackCount[posIndex];
-    int8_t blackAC = evalContext.blackAttackCount[posIndex];
-    if(whiteAC == 0 && blackAC == 0) {
-      continue;
-      record.score+=UNDEFENDED_PIECE_PENALTY_NO_ATTACKERS*pieceSign;
-    }
-    
-    // there's a piece, attacker count > 0
-    if(pieceType == PieceType::KING_PIECE && pieceSide!=movingSide && ((pieceSide == Side::WHITE && blackAC>0) || (pieceSide == Side::BLACK && whiteAC>0))) {
-      // king is attacked on opponents move, after-checkmate
-      // remove pseudo-legal moves
-      record.moves.clear();
-      setExactScore(record, AFTER_CHECKMATE_SCORE*movingSideSign);
-      return record;
-    }
-
-    
-    if(pieceType == PieceType::KING_PIECE) {
-      if(pieceSide == Side::WHITE ? blackAC>0 : whiteAC>0) {
-        // it's a check
-        record.score+= CHECK_PENALTY*pieceSign;
-        record.isQuietPosition = false;
-      }
-    } else {
-      // more attackers than defenders
-      // not-king piece
-      if(pieceSide == Side::WHITE ? blackAC>whiteAC : whiteAC>blackAC) {
-        record.score+=UNDEFENDED_PIECE_PENALTY_WITH_ATTACKERS*pieceSign;
-      }
+  }
+  std::vector<EvalContext> contexts;
+  WorkStealingPool pool;
+};
 
-      // no attackers, 1+ defenders
-      if(pieceSide == Side::WHITE ? (blackAC==0) && (whiteAC > 0) : (whiteAC==0)&&(blackAC>0)) {
-        record.score+=NO_ATTACKERS_HAVE_DEFENDERS_BONUS*pieceSign;
-      }
-    }
+EvalRecord Engine::evaluateBoard(const Board& board) {
+  EvalRecord record;
+  Side movingSide = board.getMovingSide();
+  int8_t movingSideSign = Board::getSideSign(movingSide);
+  if(board.isInCheck(Board::getOpponentSide(movingSide))) {
+    // king is attacked on opponents move, after-checkmate
+    setExactScore(record, AFTER_CHECKMATE_SCORE*movingSideSign);
+    return record;
   }
 
+  generateMoves(board, record.moves);
+  record.isQuietPosition = !board.isInCheck(movingSide);
   if(record.moves.size() == 0) {
-    setExactScore(record, STALEMATE_SCORE*movingSideSign);
+    // no legal moves: checkmate or stalemate
+    setExactScore(record, record.isQuietPosition ? STALEMATE_SCORE*movingSideSign : -CHECKMATE_SCORE*movingSideSign);
     return record;
   }
 
-  // TODO: doubled pawn penalty
-  // TODO: positive/negative attack balance penalty/bonus ?
-
+  record.score = chesseng::evaluate(board);
   record.evalStatus = EvalStatus::DONE_COMPLETE;
   return record;
 }
 
-inline void swapMoves(std::vector<Move>& moves, size_t from, size_t to) {
-  if(from!=to) {
-    Move tmp = moves[from];
-    moves[from]=moves[to];
-    moves[to] = tmp;
-  }
-}
-
 #if SORT_MOVES == 1
-struct MoveScore{
-  MoveScore(){}
-  MoveScore(Move move, Side movingSide):move(move),movingSide(movingSide) {}
-  void setRecord(EvalRecord* record) {
-    this->record = record;
-  }
-  
-  Move move;
-  Side movingSide;
-  EvalRecord* record{nullptr};
-
-  static bool bestScoreFirst(const MoveScore& lhs, const MoveScore& rhs) {
-    if((lhs.record==nullptr) != (rhs.record==nullptr)){
-      return lhs.record!=nullptr;
-    }
-    if((lhs.record==nullptr)&&(rhs.record==nullptr)) {
-      int16_t ltypeScore = lhs.move.getMoveType()==MoveType::CAPTURE ? 1 : 0;
-      int16_t rtypeScore = rhs.move.getMoveType()==MoveType::CAPTURE ? 1 : 0;
-      if(ltypeScore!=rtypeScore) {
-        return ltypeScore>rtypeScore;
-      }
-      return lhs.move.data<rhs.move.data;
-    }
-
-    // both moves have record
-    if(lhs.record->evalStatus!=rhs.record->evalStatus) {
-      return lhs.record->evalStatus==EvalStatus::DONE_COMPLETE;
-    }
-
-    int16_t lscore = lhs.record->evalStatus == EvalStatus::DONE_PARTIAL ? (lhs.movingSide == Side::WHITE ? lhs.record->minWhite : lhs.record->maxBlack) : lhs.record->score;
-    int16_t rscore = rhs.record->evalStatus == EvalStatus::DONE_PARTIAL ? (rhs.movingSide == Side::WHITE ? rhs.record->minWhite : rhs.record->maxBlack) : rhs.record->score;
-
-    if(lscore==rscore) {
-      int16_t ltypeScore = lhs.move.getMoveType()==MoveType::CAPTURE ? 1 : 0;
-      int16_t rtypeScore = rhs.move.getMoveType()==MoveType::CAPTURE ? 1 : 0;
-      if(ltypeScore!=rtypeScore) {
-        return ltypeScore>rtypeScore;
-      }
-      lscore = lhs.record->score;
-      rscore = rhs.record->score;
+// transposition table move first, then captures, ties by from and to positions
+void sortMoves(MoveList& moves, Move ttMove) {
+  for(size_t i=0;i<moves.size();i++) {
+    if(moves[i].data == ttMove.data) {
+      moves.scores[i] = 2;
+    } else if(moves[i].isCapture()) {
+      moves.scores[i] = 1;
+    } else {
+      moves.scores[i] = 0;
     }
-
-    // record scores are different
-    if(lscore!=rscore) {
-      return (lhs.movingSide==Side::WHITE) ? lscore>rscore : lscore<rscore;
+  }
+  // insertion sort, lists are short and mostly in order already
+  for(size_t i=1;i<moves.size();i++) {
+    Move move = moves[i];
+    int16_t score = moves.scores[i];
+    size_t j = i;
+    for(;j>0 && (moves.scores[j-1] < score || (moves.scores[j-1] == score && moves[j-1].getFromTo() > move.getFromTo()));j--) {
+      moves[j] = moves[j-1];
+      moves.scores[j] = moves.scores[j-1];
     }
-
-    // record scores are same
-    return lhs.move.data<rhs.move.data;
+    moves[j] = move;
+    moves.scores[j] = score;
   }
-  
-};
-
-void sortMoveScores(std::vector<MoveScore>& moveScores, std::vector<Move>& moves, size_t sortBeginIndex, size_t sortEndIndex) {
-  std::sort(moveScores.begin()+sortBeginIndex,moveScores.begin()+sortEndIndex, &MoveScore::bestScoreFirst);
-  for(int i=sortBeginIndex;i<sortEndIndex;i++) {
-    moves[i] = moveScores[i].move;
+}
+#else
+// transposition table move first
+void sortMoves(MoveList& moves, Move ttMove) {
+  for(size_t i=0;i<moves.size();i++) {
+    if(moves[i].data == ttMove.data) {
+      std::swap(moves[0], moves[i]);
+      return;
+    }
   }
 }
 #endif
@@ -542,280 +184,571 @@ enum class SearchMode:uint8_t{
   QUIET=1
 };
 
-EvalResult Engine::evaluate(const Board& board, EvalContext& context, int16_t toDepth, int16_t minWhite, int16_t maxBlack, int16_t toQsDepth, bool fromQuietMove) {
-  auto it = evals.find(board);
-  EvalRecord* record;
-  
-  // Get eval record or create new record and run heuristics
-  if(it != evals.end()) {
-    record = &(it->second);
-  } else {
-    auto insertRes = evals.insert(std::pair<Board,EvalRecord>(board, Engine::evaluateBoard(board)));
-    record = &(insertRes.first->second);
-    context.nodesEvaluated++;
-    if(context.nodesEvaluated % context.nodesEvaluatedCallbackInterval == 0) {
-      context.nodesEvaluatedCallback();
-      if(context.searchShouldTimeout()) {
-        return EvalResult(nullptr, EvalResultCode::TIMEOUT, 0);
-      }
-    }
+Engine::Engine(size_t ttSizeMb):tt(ttSizeMb) {
+}
+
+void Engine::setHashSizeMb(size_t sizeMb) {
+  tt.resize(sizeMb);
+}
+
+void Engine::clearHash() {
+  tt.clear();
+}
+
+bool Engine::loadNetwork(const std::string& path) {
+  NnueNetwork loaded;
+  if(!loaded.loadFile(path)) {
+    return false;
   }
+  setNetwork(std::move(loaded));
+  return true;
+}
+
+void Engine::setNetwork(NnueNetwork newNetwork) {
+  network = std::make_unique<NnueNetwork>(std::move(newNetwork));
+  // scores of the other evaluation must not be mixed in
+  tt.clear();
+}
+
+EvalResult Engine::evaluate(Board& board, EvalContext& context, int16_t toDepth, int16_t alpha, int16_t beta, int16_t toQsDepth, bool fromQuietMove) {
+  uint64_t key = board.hash;
 
   // Handle evaluation cycle
-  if(record->evalStatus == EvalStatus::IN_EVALUATION) {
-    return EvalResult(nullptr, EvalResultCode::LOOP, 0);
+  if(context.isOnSearchPath(key)) {
+    return EvalResult(EvalResultCode::LOOP, 0);
+  }
+  // no side can win, nothing to search; the root still needs a move
+  if(!context.searchPath.empty() && isKnownDraw(board)) {
+    return EvalResult(EvalResultCode::SUCCESS, 0);
   }
 
-  // Handle partial record: if depth is sufficient and min/max cutoff applies, return cutoff.
-  // Else do regular move search
-  if(record->evalStatus == EvalStatus::DONE_PARTIAL) {
-    if(record->evalDepth >= toDepth && record->qsEvalDepth >= toQsDepth) {
-      if(board.getMovingSide() == Side::WHITE && record->maxBlack >= maxBlack) {
-        return EvalResult(record, EvalResultCode::SUCCESS, maxBlack);
+  Side movingSide = board.getMovingSide();
+  int8_t movingSideSign = Board::getSideSign(movingSide);
+  TTEntry entry;
+  bool entryFound = tt.probe(key, entry);
+  Move ttMove;
+  uint8_t recordDepth = 0;
+  uint8_t recordQsDepth = 0;
+  if(entryFound) {
+    ttMove = entry.bestMove;
+    BoundType bound = entry.getBound();
+    if(bound == BoundType::EXACT) {
+      recordDepth = entry.depth;
+      recordQsDepth = entry.qsDepth;
+      bool quietSearchRequired = !entry.isQuietPosition() || !fromQuietMove;
+      if(recordDepth >= toDepth && (!quietSearchRequired || recordQsDepth >= toQsDepth)) {
+        return EvalResult(EvalResultCode::SUCCESS, entry.score*movingSideSign, ttMove);
+      }
+    } else if(entry.depth >= toDepth && entry.qsDepth >= toQsDepth) {
+      // Handle bound entry: if depth is sufficient and the bound is outside of the window, return it as the cutoff score.
+      // Else do regular move search
+      int16_t score = entry.score*movingSideSign;
+      if(bound == getLowerBound(movingSide) && score >= beta) {
+        return EvalResult(EvalResultCode::SUCCESS, score, ttMove);
       }
-      if(board.getMovingSide() == Side::BLACK && record->minWhite <= minWhite) {
-        return EvalResult(record, EvalResultCode::SUCCESS, minWhite);
+      if(bound == getUpperBound(movingSide) && score <= alpha) {
+        return EvalResult(EvalResultCode::SUCCESS, score, ttMove);
       }
     }
-    
-    // Partial record is not useful to this search, do regular search
-    record->evalDepth=0;
-    record->qsEvalDepth=0;
-    record->evalStatus = EvalStatus::DONE_COMPLETE;
   }
 
+  bool inCheck = board.isInCheck(movingSide);
+  context.nodesEvaluated++;
+  if(context.nodesEvaluated % context.nodesEvaluatedCallbackInterval == 0) {
+    context.nodesEvaluatedCallback();
+    if(context.searchShouldTimeout()) {
+      return EvalResult(EvalResultCode::TIMEOUT, 0);
+    }
+  }
+  // a cutoff at a split point above, the result is not needed
+  if(context.splitPoint && context.splitPoint->isCancelled()) {
+    return EvalResult(EvalResultCode::TIMEOUT, 0);
+  }
 
   // is eval for quiet position?
-  bool quietSearchRequired = !record->isQuietPosition || !fromQuietMove;
+  bool quietSearchRequired = inCheck || !fromQuietMove;
+  bool depthAchieved = recordDepth >= toDepth;
   // regular search + qs search cases:
   // case #1: record depth < toDepth, do regular move search
-  // case #2: record depth >= toDepth, position is quiet: return record
+  // case #2: record depth >= toDepth, position is quiet: return static eval
   // case #3: record depth >= toDepth, position is not quiet, record qsDepth < toQsDepth: do quiet search
-  // case #4: record depth >= toDepth, position is not quiet, record qsDepth >= toQsDepth: return record
+  // case #4: record depth >= toDepth, position is not quiet, record qsDepth >= toQsDepth: return static eval
+
+  // case #2 and #4 without check: score only, no move generation
+  if(depthAchieved && !inCheck && (!quietSearchRequired || recordQsDepth >= toQsDepth)) {
+    // the margin is measured for the hand-written evaluation only, known endings are scored apart from material
+    if(!board.network && board.phase > ENDGAME_MAX_PHASE) {
+      int16_t lazyScore = evaluateMaterialPst(board)*movingSideSign;
+      // outside of the window by more than the margin, the full eval cannot change the parent's choice;
+      // the margin's end towards the window is a bound of the full eval
+      if(lazyScore + LAZY_EVAL_MARGIN <= alpha) {
+        return EvalResult(EvalResultCode::SUCCESS, lazyScore + LAZY_EVAL_MARGIN);
+      }
+      if(lazyScore - LAZY_EVAL_MARGIN >= beta) {
+        return EvalResult(EvalResultCode::SUCCESS, lazyScore - LAZY_EVAL_MARGIN);
+      }
+    }
+    int16_t score = chesseng::evaluate(board);
+    tt.store(key, Move(), score, BoundType::EXACT, recordDepth, recordQsDepth, true);
+    return EvalResult(EvalResultCode::SUCCESS, score*movingSideSign);
+  }
 
-  // case #2
-  bool quietAndDepthAchieved = record->evalDepth >= toDepth && !quietSearchRequired;
-  // case #4
-  bool notQuietAndDepthAchievedAndQsDepthAchived = record->evalDepth >= toDepth && record->qsEvalDepth>=toQsDepth;
-  if(quietAndDepthAchieved || notQuietAndDepthAchievedAndQsDepthAchived) {
-    return EvalResult(record, EvalResultCode::SUCCESS, record->score);
+  MoveList moves;
+  generateMoves(board, moves);
+  if(moves.size() == 0) {
+    // no legal moves: checkmate or stalemate
+    int16_t score = inCheck ? -CHECKMATE_SCORE : STALEMATE_SCORE;
+    tt.store(key, Move(), score*movingSideSign, BoundType::EXACT, EXACT_EVAL_DEPTH, recordQsDepth, !inCheck);
+    return EvalResult(EvalResultCode::SUCCESS, score);
   }
 
-  SearchMode searchMode = (record->evalDepth < toDepth) ? SearchMode::REGULAR : SearchMode::QUIET;
+  // case #4 in check
+  if(depthAchieved && recordQsDepth >= toQsDepth) {
+    int16_t score = chesseng::evaluate(board);
+    tt.store(key, Move(), score, BoundType::EXACT, recordDepth, recordQsDepth, false);
+    return EvalResult(EvalResultCode::SUCCESS, score*movingSideSign);
+  }
 
-  int16_t newScore = board.getMovingSide() == Side::WHITE ? MIN_SCORE : MAX_SCORE;
+  SearchMode searchMode = depthAchieved ? SearchMode::QUIET : SearchMode::REGULAR;
 
-  size_t bestMoveIndex=0;
+  // no move above it: the score is an upper bound
+  int16_t fromAlpha = alpha;
+  int16_t newScore = MIN_SCORE;
   Move bestMove;
 
-  #if SORT_MOVES == 1
-  std::vector<MoveScore> moveScores(record->moves.size());
-  for(int moveIndex = 0;moveIndex<record->moves.size();moveIndex++) {
-    moveScores[moveIndex] = MoveScore(record->moves[moveIndex], board.getMovingSide());
+  // stand pat: out of check the side to move does not have to capture, the static score is the least it gets
+  if(searchMode == SearchMode::QUIET && !inCheck) {
+    newScore = chesseng::evaluate(board)*movingSideSign;
+    if(newScore >= beta) {
+      tt.store(key, Move(), newScore*movingSideSign, getLowerBound(movingSide), toDepth, toQsDepth, true);
+      return EvalResult(EvalResultCode::SUCCESS, newScore);
+    }
+    alpha = std::max(alpha, newScore);
   }
-  #endif
 
-  record->evalStatus = EvalStatus::IN_EVALUATION;
-  for(int moveIndex = 0;moveIndex<record->moves.size();moveIndex++) {
-    const Move& move = record->moves[moveIndex];
-    bool examineMove = searchMode == SearchMode::REGULAR || !record->isQuietPosition || move.getMoveType()==MoveType::CAPTURE;
+  sortMoves(moves, ttMove);
+
+  context.searchPath.push_back(key);
+  bool moveSearched = false;
+  for(size_t moveIndex=0;moveIndex<moves.size();moveIndex++) {
+    const Move& move = moves[moveIndex];
+    bool examineMove = searchMode == SearchMode::REGULAR || inCheck || move.isCapture();
     if(!examineMove) {
       continue;
     }
 
-    bool quietMove = record->isQuietPosition && move.getMoveType() == MoveType::MOVE;
-    Board nextBoard = Board::makeMove(board, move.getFrom(), move.getTo(), move.getPromotionType());
-    EvalResult nextEvalResult = evaluate(nextBoard, context, toDepth > 0 ? toDepth-1 : 0, minWhite, maxBlack, toDepth > 0 ? toQsDepth : toQsDepth-1, quietMove);
+    // young brothers wait: the first move alone, the others may go to idle threads
+    if(moveSearched && splitSearch && searchMode == SearchMode::REGULAR && toDepth >= SPLIT_MIN_DEPTH && moveIndex + 1 < moves.size()
+      && splitSearch->pool.hasIdleWorkers()) {
+      Move cutoffMove;
+      EvalResultCode splitResult = searchSplitPoint(board, context, moves, moveIndex, toDepth, toQsDepth, inCheck, newScore, bestMove, alpha, beta, cutoffMove);
+      if(splitResult == EvalResultCode::TIMEOUT) {
+        context.searchPath.pop_back();
+        return EvalResult(EvalResultCode::TIMEOUT, 0);
+      }
+      if(cutoffMove.data != 0) {
+        context.searchPath.pop_back();
+        tt.store(key, cutoffMove, newScore*movingSideSign, getLowerBound(movingSide), toDepth, toQsDepth, !inCheck);
+        return EvalResult(EvalResultCode::SUCCESS, newScore, cutoffMove);
+      }
+      break;
+    }
+
+    bool quietMove = !inCheck && !move.isCapture();
+    UndoRecord undo;
+    board.doMove(move, undo);
+    EvalResult nextEvalResult = searchMove(board, context, toDepth > 0 ? toDepth-1 : 0, alpha, beta, toDepth > 0 ? toQsDepth : toQsDepth-1, quietMove,
+      moveSearched && searchMode == SearchMode::REGULAR);
+    board.undoMove(move, undo);
     if(nextEvalResult.result == EvalResultCode::TIMEOUT) {
-      record->evalStatus = EvalStatus::DONE_COMPLETE;
-      record->evalDepth=0;
-      record->qsEvalDepth=0;
-      return EvalResult(nullptr, EvalResultCode::TIMEOUT, 0);
+      context.searchPath.pop_back();
+      return EvalResult(EvalResultCode::TIMEOUT, 0);
     } else if(nextEvalResult.result == EvalResultCode::LOOP) {
       continue;
     } else if(nextEvalResult.result!= EvalResultCode::SUCCESS) {
       assert(nextEvalResult.result == EvalResultCode::SUCCESS);
     }
+    moveSearched = true;
 
-    #if SORT_MOVES == 1
-    moveScores[moveIndex].setRecord(nextEvalResult.record);
-    #endif
-
-    if((board.getMovingSide() == Side::WHITE && newScore < nextEvalResult.score)
-      || (board.getMovingSide() == Side::BLACK && newScore > nextEvalResult.score)) {
-      newScore = nextEvalResult.score;
-      bestMoveIndex = moveIndex;
-      bestMove = move;
-    }
-    
-    if(board.getMovingSide() == Side::WHITE) {
-      // alphabeta max
-      if(newScore >= maxBlack) {
-        record->maxBlack = maxBlack;
-        record->evalStatus = EvalStatus::DONE_PARTIAL;
-        record->evalDepth = toDepth;
-        record->qsEvalDepth = toQsDepth;
-        record->bestMove=move;
-        #if SORT_MOVES == 1
-        sortMoveScores(moveScores, record->moves, 1, moveIndex+1);
-        #else 
-        swapMoves(record->moves, 0, moveIndex);
-        #endif
-        return EvalResult(record, EvalResultCode::SUCCESS, maxBlack);
-      }
-      if(newScore > minWhite) {
-        minWhite = newScore;
-      }
-    } else {
-      //alphabeta min
-      if(newScore<=minWhite) {
-        record->minWhite = minWhite;
-        record->evalStatus = EvalStatus::DONE_PARTIAL;
-        record->evalDepth = toDepth;
-        record->qsEvalDepth = toQsDepth;
-        record->bestMove=move;
-        #if SORT_MOVES == 1
-        sortMoveScores(moveScores, record->moves, 1, moveIndex + 1);
-        #else
-        swapMoves(record->moves, 0, moveIndex);
-        #endif
-        return EvalResult(record, EvalResultCode::SUCCESS, minWhite);
-      }
-      if(newScore<maxBlack) {
-        maxBlack = newScore;
-      }
+    if(updateWindow(nextEvalResult.score, move, newScore, bestMove, alpha, beta)) {
+      context.searchPath.pop_back();
+      tt.store(key, move, newScore*movingSideSign, getLowerBound(movingSide), toDepth, toQsDepth, !inCheck);
+      return EvalResult(EvalResultCode::SUCCESS, newScore, move);
     }
   }
+  context.searchPath.pop_back();
+
+  if(newScore != MIN_SCORE && newScore <= fromAlpha) {
+    // fail low: every move is at most alpha, the best move is not known
+    tt.store(key, Move(), newScore*movingSideSign, getUpperBound(movingSide), toDepth, toQsDepth, !inCheck);
+    return EvalResult(EvalResultCode::SUCCESS, newScore);
+  }
 
-  if(newScore != MIN_SCORE && newScore !=MAX_SCORE) {
-    record->score = newScore;
+  int16_t score;
+  if(newScore != MIN_SCORE) {
+    score = newScore;
   } else {
     // quiet search found no capture moves / post-check moves, return heuristic result
+    score = chesseng::evaluate(board)*movingSideSign;
   }
-  record->evalStatus = EvalStatus::DONE_COMPLETE;
-  record->evalDepth = toDepth;
-  record->qsEvalDepth = toQsDepth;
-  record->bestMove=bestMove;
-  #if SORT_MOVES == 1
-  sortMoveScores(moveScores, record->moves, 0, record->moves.size());
-  #else
-  swapMoves(record->moves, 0, bestMoveIndex);
-  #endif
   
-  if(std::abs(record->score)>AFTER_CHECKMATE_SCORE/2) {
+  if(std::abs(score)>AFTER_CHECKMATE_SCORE/2) {
     // adjust score for mate distance
-    record->score += (record->score>0) ? DISTANT_CHECKMATE_DECAY : -DISTANT_CHECKMATE_DECAY;
+    score += (score>0) ? DISTANT_CHECKMATE_DECAY : -DISTANT_CHECKMATE_DECAY;
+  }
+
+  tt.store(key, bestMove, score*movingSideSign, BoundType::EXACT, toDepth, toQsDepth, !inCheck);
+  return EvalResult(EvalResultCode::SUCCESS, score, bestMove);
+}
+
+EvalResult Engine::searchMove(Board& board, EvalContext& context, int16_t toDepth, int16_t alpha, int16_t beta, int16_t toQsDepth, bool fromQuietMove, bool nullWindow) {
+  // principal variation search: a move after the first one is only shown to be no better than alpha,
+  // searched again with the full window if it is
+  if(PV_SEARCH == 1 && nullWindow && beta - alpha > 1) {
+    EvalResult result = evaluate(board, context, toDepth, -alpha-1, -alpha, toQsDepth, fromQuietMove);
+    if(result.result != EvalResultCode::SUCCESS || -result.score <= alpha) {
+      return EvalResult(result.result, -result.score, result.bestMove);
+    }
+  }
+  EvalResult result = evaluate(board, context, toDepth, -beta, -alpha, toQsDepth, fromQuietMove);
+  return EvalResult(result.result, -result.score, result.bestMove);
+}
+
+EvalResultCode Engine::searchSplitPoint(Board& board, EvalContext& context, const MoveList& moves, size_t fromIndex, int16_t toDepth, int16_t toQsDepth, bool inCheck,
+  int16_t& newScore, Move& bestMove, int16_t& alpha, int16_t beta, Move& cutoffMove) {
+  SplitPoint splitPoint;
+  splitPoint.parent = context.splitPoint;
+  splitPoint.board = board;
+  splitPoint.moves = moves;
+  splitPoint.searchPath = context.searchPath;
+  splitPoint.toDepth = toDepth;
+  splitPoint.toQsDepth = toQsDepth;
+  splitPoint.inCheck = inCheck;
+  splitPoint.nextMove = fromIndex;
+  splitPoint.newScore = newScore;
+  splitPoint.bestMove = bestMove;
+  splitPoint.alpha = alpha;
+  splitPoint.beta = beta;
+
+  WorkStealingPool& pool = splitSearch->pool;
+  size_t helpers = std::min(pool.getIdleWorkers(), moves.size() - fromIndex - 1);
+  splitPoint.pendingTasks = helpers;
+  for(size_t i=0;i<helpers;i++) {
+    pool.push(context.workerIndex, &splitPoint, [this, &splitPoint](size_t worker) {
+      EvalContext& workerContext = splitSearch->contexts[worker];
+      setPawnTable(pawnTables[worker].get());
+      // a waiting owner runs tasks inside its own search, its node is given back afterwards
+      std::vector<uint64_t> ownerSearchPath = std::move(workerContext.searchPath);
+      const SplitPoint* ownerSplitPoint = workerContext.splitPoint;
+      workerContext.searchPath = splitPoint.searchPath;
+      workerContext.splitPoint = &splitPoint;
+      Board workerBoard = splitPoint.board;
+      searchSplitMoves(splitPoint, workerBoard, workerContext);
+      workerContext.searchPath = std::move(ownerSearchPath);
+      workerContext.splitPoint = ownerSplitPoint;
+      // the owner may return as soon as this is 0
+      splitPoint.pendingTasks--;
+    });
+  }
+  context.splitPoints++;
+
+  context.splitPoint = &splitPoint;
+  searchSplitMoves(splitPoint, board, context);
+  context.splitPoint = splitPoint.parent;
+  // tasks nobody took would find no moves left
+  splitPoint.pendingTasks -= pool.cancel(context.workerIndex, &splitPoint);
+  // a queued task's split point is alive, its owner waits for it
+  TaskFilter belowSplitPoint = [&splitPoint](const void* tag) {
+    for(const SplitPoint* taskSplitPoint=static_cast<const SplitPoint*>(tag);taskSplitPoint;taskSplitPoint=taskSplitPoint->parent) {
+      if(taskSplitPoint == &splitPoint) {
+        return true;
+      }
+    }
+    return false;
+  };
+  while(splitPoint.pendingTasks > 0) {
+    // helpers check the stop and the limits themselves, the owner's check ends the split point sooner
+    if(!splitPoint.cutoff && !splitPoint.aborted && context.searchShouldTimeout()) {
+      splitPoint.aborted = true;
+    }
+    // helpful master: queued tasks instead of spinning until the helpers are done, only those of this split point
+    // and the ones below it, another task could still be running when the helpers are done here
+    if(!pool.runOne(context.workerIndex, belowSplitPoint)) {
+      std::this_thread::yield();
+    }
   }
 
-  return EvalResult(record, EvalResultCode::SUCCESS, record->score);
+  newScore = splitPoint.newScore;
+  bestMove = splitPoint.bestMove;
+  alpha = splitPoint.alpha;
+  // a cutoff result stands even if the search above was stopped meanwhile
+  if(splitPoint.cutoff) {
+    cutoffMove = splitPoint.cutoffMove;
+    return EvalResultCode::SUCCESS;
+  }
+  return splitPoint.aborted ? EvalResultCode::TIMEOUT : EvalResultCode::SUCCESS;
 }
 
-EvalRecord* Engine::findRecord(const Board& board) {
-  auto it = evals.find(board);
-  if(it != evals.end()) {
-    return &(it->second);
+void Engine::searchSplitMoves(SplitPoint& splitPoint, Board& board, EvalContext& context) {
+  while(!splitPoint.cutoff && !splitPoint.aborted) {
+    size_t moveIndex = splitPoint.nextMove++;
+    if(moveIndex >= splitPoint.moves.size()) {
+      break;
+    }
+    Move move = splitPoint.moves[moveIndex];
+    int16_t alpha;
+    {
+      std::lock_guard<std::mutex> lock(splitPoint.mutex);
+      alpha = splitPoint.alpha;
+    }
+    bool quietMove = !splitPoint.inCheck && !move.isCapture();
+    UndoRecord undo;
+    board.doMove(move, undo);
+    // never the first move of the node
+    EvalResult nextEvalResult = searchMove(board, context, splitPoint.toDepth-1, alpha, splitPoint.beta, splitPoint.toQsDepth, quietMove, true);
+    board.undoMove(move, undo);
+    if(nextEvalResult.result == EvalResultCode::TIMEOUT) {
+      if(!splitPoint.cutoff) {
+        splitPoint.aborted = true;
+      }
+      break;
+    } else if(nextEvalResult.result == EvalResultCode::LOOP) {
+      continue;
+    }
+    std::lock_guard<std::mutex> lock(splitPoint.mutex);
+    if(!splitPoint.cutoff && updateWindow(nextEvalResult.score, move, splitPoint.newScore, splitPoint.bestMove, splitPoint.alpha, splitPoint.beta)) {
+      splitPoint.cutoffMove = move;
+      splitPoint.cutoff = true;
+    }
   }
-  return nullptr;
 }
 
-Move Engine::findBestMove(const Board& board, int16_t toDepth, int16_t toQsDepth, int16_t allowedTimeMs) {
-  toDepth = toDepth > MAX_DEPTH ? MAX_DEPTH : toDepth;
-  EvalContext evalContext(true, allowedTimeMs, toDepth);
+bool Engine::findEntry(const Board& board, TTEntry& entry) const {
+  return tt.probe(board.hash, entry);
+}
+
+Move Engine::findBestMove(const Board& board, int16_t toDepth, int16_t toQsDepth, int32_t moveTimeMs) {
+  SearchLimits limits;
+  limits.depth = toDepth;
+  limits.moveTime = moveTimeMs;
+  return findBestMove(board, limits, toQsDepth);
+}
 
-  // Trim evals table if needed
-  if(evals.size()>TRIM_TABLE_SIZE) {
-    evals = std::unordered_map<Board, EvalRecord, Hasher<Board>>();
+Move Engine::findBestMove(const Board& board, const SearchLimits& limits, int16_t toQsDepth) {
+  TimeManager timeManager(limits, board.getMovingSide());
+  // a depth is searched to the end, without one the time or node limit ends the deepening
+  int16_t toDepth = limits.depth > 0 ? std::min<int16_t>(limits.depth, MAX_ITERATIVE_DEPTH) : MAX_ITERATIVE_DEPTH;
+  int16_t firstDepth = 1;
+  // the limits apply from the first iteration on, a search stopped before it ends plays the table move
+  EvalContext evalContext(true, timeManager.getHardLimitMs(), 0);
+  evalContext.maxNodes = limits.nodes;
+  evalContext.stopSearch = &stopRequested;
+  evalContext.infiniteSearch = &infiniteSearch;
+  tt.newSearch();
+  while(pawnTables.size() < threads) {
+    pawnTables.push_back(std::make_unique<PawnTable>());
   }
+  setPawnTable(pawnTables[0].get());
+  getPawnTable().resetStats();
   
   std::stringstream ss;
-  ss << "Started findBestMove to depth " << toDepth;
+  ss << "Started findBestMove to depth " << toDepth << (isUsingNnue() ? ", NNUE evaluation" : "");
+  if(timeManager.getHardLimitMs() > 0) {
+    ss << ", soft limit " << timeManager.getSoftLimitMs() << "ms, hard limit " << timeManager.getHardLimitMs() << "ms";
+  }
+  if(limits.nodes > 0) {
+    ss << ", nodes " << limits.nodes;
+  }
   Log::log(ss.str());
   
-  bool haveTimeForMoreSearch = false;
-  EvalRecord* record = nullptr;
-  for(int depth=std::min(toDepth,(int16_t)3);depth<=toDepth || haveTimeForMoreSearch;depth++){
-    EvalResult result = evaluate(board, evalContext, depth, MIN_SCORE, MAX_SCORE, toQsDepth, true);
+  Board searchBoard = board;
+  searchBoard.setNetwork(isUsingNnue() ? network.get() : nullptr);
+  std::atomic<bool> stopHelpers{false};
+  std::vector<int64_t> helperNodes(threads - 1, 0);
+  std::vector<std::thread> helpers;
+  std::unique_ptr<SplitSearch> split;
+  if(parallelSearch == ParallelSearch::SPLIT_POINTS && threads > 1) {
+    split = std::make_unique<SplitSearch>(threads, evalContext);
+    splitSearch = split.get();
+  } else {
+    for(size_t i=1;i<threads;i++) {
+      helpers.emplace_back(&Engine::searchHelper, this, searchBoard, i, toDepth, toQsDepth, std::cref(stopHelpers), std::ref(helperNodes[i-1]));
+    }
+  }
+  Move bestMove;
+  // white's view
+  int16_t bestScore = 0;
+  int8_t movingSideSign = Board::getSideSign(board.getMovingSide());
+  for(int depth=firstDepth;depth<=toDepth || (infiniteSearch && depth<=MAX_ITERATIVE_DEPTH);depth++){
+    if(depth > firstDepth && !infiniteSearch && !timeManager.shouldStartIteration(evalContext.getMsSinceLimitStart())) {
+      break;
+    }
+    EvalResult result = evaluate(searchBoard, evalContext, depth, MIN_SCORE, MAX_SCORE, toQsDepth, true);
     if(result.result==EvalResultCode::SUCCESS){
-      record = result.record;
+      bestMove = result.bestMove;
+      bestScore = result.score*movingSideSign;
     } else {
       break;
     }
 
     evalContext.depthAchieved = depth;
+    if(split) {
+      // no split point is open between iterations, the pool's locks order this before the workers' next tasks
+      for(EvalContext& workerContext : split->contexts) {
+        workerContext.depthAchieved = depth;
+      }
+    }
+    timeManager.onIterationDone(bestMove);
 
     ss.str("");
     ss << "findBestMove at depth " << depth << " took " << evalContext.getMsSinceStartTime() << "ms. Evaluated boards: " << evalContext.nodesEvaluated << ". Eval result: " << (int16_t)result.result
-      << ". Best move " << record->bestMove.print() << ", score "<<record->score;
+      << ". Best move " << bestMove.print() << ", score "<<bestScore << ", hashfull " << tt.hashfull();
+    if(timeManager.getSoftLimitMs() > 0) {
+      ss << ", soft limit scale " << timeManager.getStabilityScalePercent() << "%";
+    }
     Log::log(ss.str());
-    haveTimeForMoreSearch=(allowedTimeMs>0 && depth<toDepth*2 && evalContext.getMsSinceStartTime() < (allowedTimeMs / 6));
   }
-  auto endTime = std::chrono::steady_clock::now();
-  
+  // the bestmove of an infinite search is sent only after stop or ponderhit
+  while(infiniteSearch && !stopRequested) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(INFINITE_SEARCH_POLL_MS));
+  }
+  stopHelpers = true;
+  for(auto& helper : helpers) {
+    helper.join();
+  }
+  // stopped before the first iteration was done: the table move if it is legal here, else any legal move
+  if(bestMove.data == 0) {
+    MoveList moves;
+    generateMoves(board, moves);
+    TTEntry entry;
+    if(findEntry(board, entry) && std::find_if(moves.begin(), moves.end(), [&entry](const Move& move) { return move.data == entry.bestMove.data; }) != moves.end()) {
+      bestMove = entry.bestMove;
+    } else if(moves.size() > 0) {
+      bestMove = moves[0];
+    }
+  }
+  lastSearchThreadStats.assign(threads, SearchThreadStats());
+  lastSearchThreadStats[0].nodes = evalContext.nodesEvaluated;
+  lastSearchThreadStats[0].splitPoints = evalContext.splitPoints;
+  for(size_t i=0;i<threads;i++) {
+    SearchThreadStats& stats = lastSearchThreadStats[i];
+    if(split) {
+      // the main thread's tasks, run while it waited at its split points, used contexts[0]
+      stats.nodes += split->contexts[i].nodesEvaluated;
+      stats.splitPoints += split->contexts[i].splitPoints;
+      stats.tasks = split->pool.getTasksRun(i);
+      stats.steals = split->pool.getSteals(i);
+    } else if(i > 0) {
+      stats.nodes = helperNodes[i-1];
+    }
+  }
+  splitSearch = nullptr;
+  split.reset();
+  lastSearchNodes = 0;
+  for(const SearchThreadStats& stats : lastSearchThreadStats) {
+    lastSearchNodes += stats.nodes;
+  }
+
   ss.str("");
-  ss << "info score cp " << (board.getMovingSide() == Side::WHITE?1:-1) * record->score;
+  ss << "info score cp " << (board.getMovingSide() == Side::WHITE?1:-1) * bestScore << " hashfull " << tt.hashfull();
   loggedcoutline(ss.str());
 
   ss.str("");
-  ss << "Done findBestMove in " << evalContext.getMsSinceStartTime() << "ms. Eval: " << (record->score/100.0);
+  ss << "Done findBestMove in " << evalContext.getMsSinceStartTime() << "ms. Eval: " << (bestScore/100.0) << ". Nodes of " << threads << " threads: " << lastSearchNodes;
+  Log::log(ss.str());
+  if(threads > 1) {
+    ss.str("");
+    ss << (parallelSearch == ParallelSearch::SPLIT_POINTS ? "Split points" : "Lazy SMP") << " threads (nodes/split points/tasks/steals):";
+    for(const SearchThreadStats& stats : lastSearchThreadStats) {
+      ss << " " << stats.nodes << "/" << stats.splitPoints << "/" << stats.tasks << "/" << stats.steals;
+    }
+    Log::log(ss.str());
+  }
+
+  const PawnTableStats& pawnStats = getPawnTable().getStats();
+  ss.str("");
+  ss << "Pawn table: " << pawnStats.probes << " probes, " << (pawnStats.probes ? 100.0 * pawnStats.hits / pawnStats.probes : 0)
+    << "% hits, " << pawnStats.shieldUpdates << " shield updates";
   Log::log(ss.str());
+  // the calling thread may outlive the engine
+  setPawnTable(nullptr);
 
   ss.str("");
   ss << "Best move sequence: ";
-  auto moveSeq = getBestMoveSequence(board);
-  for(const auto& move:moveSeq){
+  for(const auto& move:getBestMoveSequence(board)){
     ss << move.print() << " ";
   }
-  std::unordered_set<Board, Hasher<Board>> seenBoards;
-  Board curBoard = board;
-  EvalRecord* curRecord = record;
-  while(curRecord!=nullptr && curRecord->evalDepth > 0 && curRecord->moves.size()>0) {
-    seenBoards.insert(curBoard);
-    ss << curRecord->bestMove.print() << " ";
-    curBoard = Board::makeMove(curBoard, curRecord->bestMove);
-    curRecord = findRecord(curBoard);
-    if(seenBoards.find(curBoard) != seenBoards.end()) {
-      curRecord = nullptr;
-    }
-  }
   Log::log(ss.str());
 
-  return record->bestMove;
+  return bestMove;
+}
+
+// iterative deepening until the main thread is done, odd helpers one ply ahead of the others
+void Engine::searchHelper(Board board, size_t helperIndex, int16_t toDepth, int16_t toQsDepth, const std::atomic<bool>& stop, int64_t& nodes) {
+  EvalContext context(false);
+  context.stopSearch = &stop;
+  context.reportProgress = false;
+  setPawnTable(pawnTables[helperIndex].get());
+  for(int depth=std::min(toDepth,(int16_t)3) + helperIndex % 2;depth<=toDepth*2 && !stop;depth++) {
+    if(evaluate(board, context, depth, MIN_SCORE, MAX_SCORE, toQsDepth, true).result != EvalResultCode::SUCCESS) {
+      break;
+    }
+  }
+  nodes = context.nodesEvaluated;
 }
 
 std::vector<Move> Engine::getBestMoveSequence(const Board& board) {
   std::vector<Move> res;
-  std::unordered_set<Board, Hasher<Board>> seenBoards;
+  std::unordered_set<uint64_t> seenKeys;
   Board curBoard = board;
-  EvalRecord* curRecord = findRecord(board);
-  while(curRecord!=nullptr && curRecord->evalDepth > 0 && curRecord->moves.size()>0) {
-    seenBoards.insert(curBoard);
-    res.push_back(curRecord->bestMove);
-    if(curRecord->moves.size() == 0) {
-     break; 
+  TTEntry entry;
+  while(findEntry(curBoard, entry) && entry.depth > 0 && entry.bestMove.data != 0) {
+    // a key collision or another thread's store can leave a move of a different position
+    MoveList moves;
+    generateMoves(curBoard, moves);
+    if(std::find_if(moves.begin(), moves.end(), [&entry](const Move& move) { return move.data == entry.bestMove.data; }) == moves.end()) {
+      break;
     }
-    curBoard = Board::makeMove(curBoard, curRecord->bestMove);
-    curRecord = findRecord(curBoard);
-    if(seenBoards.find(curBoard) != seenBoards.end()) {
-      curRecord = nullptr;
+    seenKeys.insert(curBoard.hash);
+    res.push_back(entry.bestMove);
+    UndoRecord undo;
+    curBoard.doMove(entry.bestMove, undo);
+    if(seenKeys.find(curBoard.hash) != seenKeys.end()) {
+      break;
     }
   }
   return res;
 }
 
-EvalContext::EvalContext(bool trackTime, int32_t allowedTimeMs, int16_t depthRequired) {
+EvalContext::EvalContext(bool trackTime, int32_t hardLimitMs, int16_t depthRequired) {
+  this->hardLimitMs = hardLimitMs;
+  this->depthRequired = depthRequired;
   if(trackTime) {
     startTime = std::chrono::steady_clock::now();
     lastReportTime = startTime;
+    restartLimitClock();
   }
-  this->allowedRunTimeMs = allowedTimeMs;
-  this->depthRequired = depthRequired;
 }
 
 int32_t EvalContext::getMsSinceStartTime(){
   return (std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now()-startTime)).count();
 }
 
+int32_t EvalContext::getMsSinceLimitStart(){
+  return (std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now()-limitStartTime)).count();
+}
+
+void EvalContext::restartLimitClock() {
+  limitStartTime = std::chrono::steady_clock::now();
+  if(hardLimitMs > 0) {
+    hardDeadline = limitStartTime + std::chrono::milliseconds(hardLimitMs);
+  }
+}
+
 void EvalContext::nodesEvaluatedCallback() {
+  if(!reportProgress) {
+    return;
+  }
   auto now = std::chrono::steady_clock::now();
   if((now - lastReportTime) > std::chrono::milliseconds(1000)) {
     lastReportTime = now;
@@ -823,14 +756,27 @@ void EvalContext::nodesEvaluatedCallback() {
     ss << getMsSinceStartTime() << "ms evaluated nodes: " << nodesEvaluated;
     Log::log(ss.str());
     ss.str("");
-    ss << "info depth " << depthAchieved << " nodes " << nodesEvaluated << " nps " << (int32_t)(1000 * (double)nodesEvaluated/(getMsSinceStartTime()+1));
+    ss << "info depth " << depthAchieved << " nodes " << nodesEvaluated << " nps " << (int64_t)(1000 * (double)nodesEvaluated/(getMsSinceStartTime()+1));
     loggedcoutline(ss.str());
   }
 }
 
-bool EvalContext::searchShouldTimeout() {
-  return depthAchieved>=depthRequired && (allowedRunTimeMs > 0) &&  (getMsSinceStartTime() > 2 * allowedRunTimeMs);
+bool EvalContext::isOnSearchPath(uint64_t key) const {
+  return std::find(searchPath.begin(), searchPath.end(), key) != searchPath.end();
 }
 
+bool EvalContext::searchShouldTimeout() {
+  if(stopSearch && stopSearch->load(std::memory_order_relaxed)) {
+    return true;
+  }
+  if(infiniteSearch && infiniteSearch->load(std::memory_order_relaxed)) {
+    restartLimitClock();
+    return false;
+  }
+  if(depthAchieved < depthRequired) {
+    return false;
+  }
+  return (maxNodes > 0 && nodesEvaluated >= maxNodes) || (hardLimitMs > 0 && std::chrono::steady_clock::now() >= hardDeadline);
 }
 
+}
@@ -1,55 +1,96 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <chrono>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
-#include <unordered_map>
 
 #include "board.h"
 #include "log.h"
+#include "nnue.h"
+#include "pawns.h"
+#include "timeman.h"
+#include "tt.h"
 
 namespace chesseng {
 
 constexpr int16_t MIN_SCORE = -30000;
 constexpr int16_t MAX_SCORE = 30000;
 
+// search threads of one findBestMove, the main one and helpers
+constexpr size_t MAX_SEARCH_THREADS = 256;
+
+enum class ParallelSearch: uint8_t {
+  // helpers search the whole tree on their own, sharing the transposition table
+  LAZY_SMP=0,
+  // young brothers wait: moves after the first one of a node go to a work stealing pool
+  SPLIT_POINTS=1
+};
+
+struct SearchThreadStats {
+  int64_t nodes{0};
+  // split point tasks run, taken from another thread's deque
+  int64_t tasks{0};
+  int64_t steals{0};
+  // nodes whose moves this thread shared
+  int64_t splitPoints{0};
+};
+
+struct SplitPoint;
+struct SplitSearch;
+
 enum class EvalStatus: uint8_t {
   NOT_EVALUATED=0,
-  IN_EVALUATION=1,
-  DONE_PARTIAL=2,
-  DONE_COMPLETE=3
+  DONE_COMPLETE=1
 };
 
+// heuristic evaluation of a single position, search results live in the transposition table
 struct EvalRecord {
-  EvalRecord():bestMove(){}
-  std::vector<Move> moves;
-  Move bestMove;
+  MoveList moves;
   int16_t score{0};
-  int16_t minWhite{MIN_SCORE};
-  int16_t maxBlack{MAX_SCORE};
   EvalStatus evalStatus{EvalStatus::NOT_EVALUATED};
   uint8_t evalDepth{0};
-  uint8_t qsEvalDepth{0};
 
   // position is quiet if there is no check
   bool isQuietPosition{true};
 };
 
 struct EvalContext {
-  EvalContext(bool trackTime, int32_t allowedTimeMs = 0, int16_t depthRequired = 1);
+  EvalContext(bool trackTime, int32_t hardLimitMs = 0, int16_t depthRequired = 1);
   void nodesEvaluatedCallback();
   int32_t getMsSinceStartTime();
+  // time limit clock, restarted while the search is infinite so a ponderhit starts it anew
+  int32_t getMsSinceLimitStart();
+  void restartLimitClock();
   bool searchShouldTimeout();
+  bool isOnSearchPath(uint64_t key) const;
   
-  int32_t nodesEvaluated{0};
+  // keys of positions from the search root to the current node, used for cycle detection
+  std::vector<uint64_t> searchPath;
+  int64_t nodesEvaluated{0};
   int16_t depthAchieved{0};
   int16_t depthRequired{0};
   int32_t nodesEvaluatedCallbackInterval{1000};
   std::chrono::time_point<std::chrono::steady_clock> startTime{std::chrono::time_point<std::chrono::steady_clock>::min()};
-  int32_t allowedRunTimeMs{0};
+  std::chrono::time_point<std::chrono::steady_clock> limitStartTime{std::chrono::time_point<std::chrono::steady_clock>::min()};
+  // the search is stopped at the deadline, compared with the clock every nodesEvaluatedCallbackInterval nodes
+  int32_t hardLimitMs{0};
+  std::chrono::time_point<std::chrono::steady_clock> hardDeadline{std::chrono::time_point<std::chrono::steady_clock>::max()};
+  int64_t maxNodes{0};
   std::chrono::time_point<std::chrono::steady_clock> lastReportTime{std::chrono::time_point<std::chrono::steady_clock>::min()};
+  // set from another thread to end the search: the UCI stop, the main thread for helpers
+  const std::atomic<bool>* stopSearch{nullptr};
+  // go infinite and go ponder until stop or ponderhit, no time limit
+  const std::atomic<bool>* infiniteSearch{nullptr};
+  bool reportProgress{true};
+  // split search: innermost split point of the current node, the pool worker of this context
+  const SplitPoint* splitPoint{nullptr};
+  size_t workerIndex{0};
+  int32_t splitPoints{0};
 };
 
 enum class EvalResultCode: uint8_t {
@@ -59,21 +100,102 @@ enum class EvalResultCode: uint8_t {
 };
 
 struct EvalResult {
-  EvalResult(EvalRecord* record, EvalResultCode result, int16_t score): record(record),result(result), score(score){}
-  EvalRecord* record;
-  int16_t score;
+  EvalResult(EvalResultCode result, int16_t score, Move bestMove = Move()): result(result), score(score), bestMove(bestMove){}
   EvalResultCode result;
+  int16_t score;
+  Move bestMove;
 };
 
 struct Engine {
   public:
+  explicit Engine(size_t ttSizeMb = DEFAULT_TT_SIZE_MB);
   static EvalRecord evaluateBoard(const Board& board);
-  EvalResult evaluate(const Board& board, EvalContext& evalContext, int16_t toDepth, int16_t minWhite, int16_t maxBlack, int16_t toQsDepth, bool fromQuietMove);
-  EvalRecord* findRecord(const Board& board);
-  Move findBestMove(const Board& board, int16_t toDepth, int16_t toQsDepth=2, int16_t allowedTimeMs=0);
+  // negamax, fail soft: the score is for the side to move and may be outside of alpha..beta; cutoffs return the best
+  // score found, table bounds and lazy evaluations the bound that failed, exact table hits, evaluations, mates and
+  // stalemates their own score
+  EvalResult evaluate(Board& board, EvalContext& evalContext, int16_t toDepth, int16_t alpha, int16_t beta, int16_t toQsDepth, bool fromQuietMove);
+  bool findEntry(const Board& board, TTEntry& entry) const;
+  Move findBestMove(const Board& board, const SearchLimits& limits, int16_t toQsDepth=2);
+  // to the depth, stopped after moveTimeMs if it is set
+  Move findBestMove(const Board& board, int16_t toDepth, int16_t toQsDepth=2, int32_t moveTimeMs=0);
   std::vector<Move> getBestMoveSequence(const Board& board);
+  void setHashSizeMb(size_t sizeMb);
+  void clearHash();
+  size_t getHashSizeBytes() const {
+    return tt.getSizeBytes();
+  }
+  // network file for the NNUE evaluation mode, false if it cannot be read, the loaded network is kept then
+  bool loadNetwork(const std::string& path);
+  void setNetwork(NnueNetwork newNetwork);
+  // searches use the network if one is loaded, the hand-written evaluation otherwise
+  void setUseNnue(bool use) {
+    if(use != useNnue) {
+      tt.clear();
+    }
+    useNnue = use;
+  }
+  bool isUsingNnue() const {
+    return useNnue && network;
+  }
+  // threads of findBestMove, how they split the work
+  void setThreads(size_t count) {
+    threads = std::clamp<size_t>(count, 1, MAX_SEARCH_THREADS);
+  }
+  size_t getThreads() const {
+    return threads;
+  }
+  void setParallelSearch(ParallelSearch mode) {
+    parallelSearch = mode;
+  }
+  ParallelSearch getParallelSearch() const {
+    return parallelSearch;
+  }
+  // called before findBestMove is started on a search thread: clears the stop of the previous search,
+  // an infinite search (go infinite, go ponder) returns only after stopSearch or ponderhit
+  void prepareSearch(bool infinite) {
+    stopRequested = false;
+    infiniteSearch = infinite;
+  }
+  // from another thread while findBestMove runs, it returns the best move found so far
+  void stopSearch() {
+    stopRequested = true;
+  }
+  // the pondered move was played, the search goes on under the normal time limit from now on
+  void ponderhit() {
+    infiniteSearch = false;
+  }
+  // nodes of all threads in the last findBestMove
+  int64_t getLastSearchNodes() const {
+    return lastSearchNodes;
+  }
+  // main thread first
+  const std::vector<SearchThreadStats>& getLastSearchThreadStats() const {
+    return lastSearchThreadStats;
+  }
 
   private:
-  std::unordered_map<Board, EvalRecord, Hasher<Board>> evals;
+  // the move already made on the board, the score is for the side that made it; nullWindow for the moves after the first one
+  EvalResult searchMove(Board& board, EvalContext& context, int16_t toDepth, int16_t alpha, int16_t beta, int16_t toQsDepth, bool fromQuietMove, bool nullWindow);
+  void searchHelper(Board board, size_t helperIndex, int16_t toDepth, int16_t toQsDepth, const std::atomic<bool>& stop, int64_t& nodes);
+  // searches moves from fromIndex on together with idle pool workers, window and best move are updated,
+  // cutoffMove is set on a cutoff
+  EvalResultCode searchSplitPoint(Board& board, EvalContext& context, const MoveList& moves, size_t fromIndex, int16_t toDepth, int16_t toQsDepth, bool inCheck,
+    int16_t& newScore, Move& bestMove, int16_t& alpha, int16_t beta, Move& cutoffMove);
+  // takes the split point's next moves until none are left or the node is cut off
+  void searchSplitMoves(SplitPoint& splitPoint, Board& board, EvalContext& context);
+
+  TranspositionTable tt;
+  std::unique_ptr<NnueNetwork> network;
+  bool useNnue{false};
+  size_t threads{1};
+  ParallelSearch parallelSearch{ParallelSearch::LAZY_SMP};
+  // set while a split point search runs
+  SplitSearch* splitSearch{nullptr};
+  int64_t lastSearchNodes{0};
+  std::vector<SearchThreadStats> lastSearchThreadStats;
+  // by thread slot, main thread first: kept from one search to the next, the threads are not
+  std::vector<std::unique_ptr<PawnTable>> pawnTables;
+  std::atomic<bool> stopRequested{false};
+  std::atomic<bool> infiniteSearch{false};
 };
 }
\ No newline at end of file
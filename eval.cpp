@@ -0,0 +1,193 @@
+#include "eval.h"
+
+#include <algorithm>
+#include <array>
+
+#include "attackcount.h"
+#include "endgame.h"
+#include "pawns.h"
+
+namespace chesseng {
+namespace {
+// pawn structure only changes on pawn moves and captures, one table per thread;
+// search threads use their engine's table, which outlives the thread
+thread_local PawnTable* boundPawnTable = nullptr;
+
+// midgame and endgame halves, blended by the board's game phase
+constexpr PstScore CAN_MOVE_BONUS{4, 6};
+constexpr PstScore UNDEFENDED_PIECE_PENALTY_WITH_ATTACKERS{-75, -75};
+constexpr PstScore NO_ATTACKERS_HAVE_DEFENDERS_BONUS{20, 10};
+constexpr PstScore CHECK_PENALTY{-100, -50};
+// network scores stay clear of the mate scores
+constexpr int16_t NNUE_SCORE_LIMIT = AFTER_CHECKMATE_SCORE/2 - 1;
+
+// squares attacked by pawns towards the a and h files
+inline std::array<Bitboard,2> getPawnAttacks(Bitboard pawns, Side side) {
+  if(side == Side::WHITE) {
+    return {(pawns & ~FILE_A_BB) << 7, (pawns & ~colBB(7)) << 9};
+  }
+  return {(pawns & ~FILE_A_BB) >> 9, (pawns & ~colBB(7)) >> 7};
+}
+}
+
+PawnTable& getPawnTable() {
+  if(boundPawnTable) {
+    return *boundPawnTable;
+  }
+  // built on the first use only, threads with a bound table never allocate it
+  thread_local PawnTable ownPawnTable;
+  return ownPawnTable;
+}
+
+void setPawnTable(PawnTable* table) {
+  boundPawnTable = table;
+}
+
+int16_t evaluate(const Board& board) {
+  if(board.network) {
+    return evaluateNnue(board);
+  }
+  PstScore score = board.pstScore;
+  const PawnEntry& pawns = getPawnTable().probe(board);
+  score += pawns.structure;
+  score += pawns.shield;
+  Side movingSide = board.getMovingSide();
+  Side waitingSide = Board::getOpponentSide(movingSide);
+  Bitboard occupancy = board.getOccupancy();
+  const std::array<int8_t, 64>& whiteAttackCount = board.attackCount[static_cast<uint8_t>(Side::WHITE)];
+  const std::array<int8_t, 64>& blackAttackCount = board.attackCount[static_cast<uint8_t>(Side::BLACK)];
+
+  // attacked squares and attacks on squares without own pieces, read from the incremental attack counts
+  AttackCountSummary summary = summarizeAttackCounts(whiteAttackCount, blackAttackCount);
+  std::array<Bitboard, 2> attacked{summary.whiteAttacked, summary.blackAttacked};
+  std::array<int16_t, 2> notOwnAttackCount{summary.whiteTotal, summary.blackTotal};
+  for(Side side : {Side::WHITE, Side::BLACK}) {
+    const std::array<int8_t, 64>& sideAttackCount = board.attackCount[static_cast<uint8_t>(side)];
+    for(Bitboard ownPieces = board.getOccupancy(side) & attacked[static_cast<uint8_t>(side)]; ownPieces; ) {
+      notOwnAttackCount[static_cast<uint8_t>(side)] -= sideAttackCount[popLsb(ownPieces)];
+    }
+  }
+
+  // the moving side's king does not count opponent defended squares as attacked
+  Bitboard kingNotCounted = 0;
+
+  // mobility, the waiting side is scored as if the moving side had no attacks
+  for(Side pieceSide : {waitingSide, movingSide}) {
+    Side opponentSide = Board::getOpponentSide(pieceSide);
+    int8_t pieceSign = Board::getSideSign(pieceSide);
+    Bitboard ownPieces = board.getOccupancy(pieceSide);
+    Bitboard opponentPieces = board.getOccupancy(opponentSide);
+    Bitboard opponentAttacked = pieceSide == movingSide ? attacked[static_cast<uint8_t>(opponentSide)] : 0;
+
+    // PAWN
+    Bitboard pawns = board.getPieces(pieceSide, PieceType::PAWN_PIECE);
+    Bitboard forwardMoves = (pieceSide == Side::WHITE ? pawns << 8 : pawns >> 8) & ~occupancy;
+    Bitboard twiceForwardMoves = (pieceSide == Side::WHITE ? (forwardMoves & rowBB(2)) << 8 : (forwardMoves & rowBB(5)) >> 8) & ~occupancy;
+    // forward moves are valid
+    score += CAN_MOVE_BONUS*((popcount(forwardMoves) + popcount(twiceForwardMoves))*pieceSign);
+    // TODO: blocked pawn penalty
+
+    // capture moves are valid
+    std::array<Bitboard,2> pawnAttacks = getPawnAttacks(pawns, pieceSide);
+    score += CAN_MOVE_BONUS*((popcount(pawnAttacks[0] & opponentPieces) + popcount(pawnAttacks[1] & opponentPieces))*pieceSign);
+
+    // en passant capture
+    int8_t enPassantCol = board.getEnPassantCol();
+    if(pieceSide == movingSide && enPassantCol != NO_COL) {
+      Position enPassantPos(pieceSide == Side::WHITE ? 5 : 2, enPassantCol);
+      score += CAN_MOVE_BONUS*(popcount(PAWN_ATTACKS[static_cast<uint8_t>(opponentSide)][enPassantPos.data] & pawns)*pieceSign);
+    }
+
+    // KING
+    Bitboard kings = board.getPieces(pieceSide, PieceType::KING_PIECE);
+    int16_t kingNotOwnAttackCount = 0;
+    uint8_t shortCastling = pieceSide == Side::WHITE ? WHITE_SHORT_CASTLING : BLACK_SHORT_CASTLING;
+    uint8_t longCastling = pieceSide == Side::WHITE ? WHITE_LONG_CASTLING : BLACK_LONG_CASTLING;
+    uint8_t castlingRights = board.getCastlingRights() & (shortCastling | longCastling);
+    for(Bitboard kingsLeft = kings; kingsLeft; ) {
+      uint8_t posIndex = popLsb(kingsLeft);
+      Bitboard attacks = KING_ATTACKS[posIndex];
+      kingNotOwnAttackCount += popcount(attacks & ~ownPieces);
+      // move to attacked square is invalid
+      score += CAN_MOVE_BONUS*(popcount(attacks & ~ownPieces & ~opponentAttacked)*pieceSign);
+      kingNotCounted |= attacks & ~ownPieces & opponentAttacked;
+
+      // castling
+      if(castlingRights && (posIndex & 0b111) == 4 && !(opponentAttacked & squareBB(posIndex))) {
+        Bitboard rooks = board.getPieces(pieceSide, PieceType::ROOK_PIECE);
+        Bitboard middle = squareBB(posIndex+1) | squareBB(posIndex+2);
+        if((castlingRights & shortCastling) && (rooks & squareBB(posIndex+3)) && !(middle & (occupancy | opponentAttacked))) {
+          score += CAN_MOVE_BONUS*pieceSign;
+        }
+        middle = squareBB(posIndex-1) | squareBB(posIndex-2);
+        Bitboard rookMiddle = middle | squareBB(posIndex-3);
+        if((castlingRights & longCastling) && (rooks & squareBB(posIndex-4)) && !(rookMiddle & occupancy) && !(middle & opponentAttacked)) {
+          score += CAN_MOVE_BONUS*pieceSign;
+        }
+      }
+    }
+
+    // KNIGHT, BISHOP, ROOK, QUEEN: moves to empty squares and captures are valid,
+    // attacks on squares without own pieces less the pawn and king ones
+    int16_t pieceMoves = notOwnAttackCount[static_cast<uint8_t>(pieceSide)] - kingNotOwnAttackCount
+      - popcount(pawnAttacks[0] & ~ownPieces) - popcount(pawnAttacks[1] & ~ownPieces);
+    score += CAN_MOVE_BONUS*(pieceMoves*pieceSign);
+  }
+
+  // attacker count eval, the moving side's king correction only touches the squares next to it
+  Bitboard whiteAttackers = summary.whiteAttacked;
+  Bitboard blackAttackers = summary.blackAttacked;
+  Bitboard whiteMore = summary.whiteMore;
+  Bitboard blackMore = summary.blackMore;
+  for(Bitboard corrected = kingNotCounted & occupancy; corrected; ) {
+    uint8_t posIndex = popLsb(corrected);
+    Bitboard posBB = squareBB(posIndex);
+    int8_t whiteAC = whiteAttackCount[posIndex] - (movingSide == Side::WHITE ? 1 : 0);
+    int8_t blackAC = blackAttackCount[posIndex] - (movingSide == Side::BLACK ? 1 : 0);
+    whiteAttackers = (whiteAttackers & ~posBB) | (whiteAC > 0 ? posBB : 0);
+    blackAttackers = (blackAttackers & ~posBB) | (blackAC > 0 ? posBB : 0);
+    whiteMore = (whiteMore & ~posBB) | (whiteAC > blackAC ? posBB : 0);
+    blackMore = (blackMore & ~posBB) | (blackAC > whiteAC ? posBB : 0);
+  }
+
+  Bitboard kings = board.getPieces(Side::WHITE, PieceType::KING_PIECE) | board.getPieces(Side::BLACK, PieceType::KING_PIECE);
+  Bitboard whitePieces = board.getOccupancy(Side::WHITE) & ~kings;
+  Bitboard blackPieces = board.getOccupancy(Side::BLACK) & ~kings;
+  std::array<Bitboard, 2> sideAttackers{whiteAttackers, blackAttackers};
+  // king is attacked on opponents move, after-checkmate
+  if(board.getPieces(waitingSide, PieceType::KING_PIECE) & sideAttackers[static_cast<uint8_t>(movingSide)]) {
+    return AFTER_CHECKMATE_SCORE*Board::getSideSign(movingSide);
+  }
+  // it's a check
+  score += CHECK_PENALTY*(popcount(board.getPieces(movingSide, PieceType::KING_PIECE) & sideAttackers[static_cast<uint8_t>(waitingSide)])*Board::getSideSign(movingSide));
+  // more attackers than defenders
+  score += UNDEFENDED_PIECE_PENALTY_WITH_ATTACKERS*(popcount(whitePieces & blackMore) - popcount(blackPieces & whiteMore));
+  // no attackers, 1+ defenders
+  score += NO_ATTACKERS_HAVE_DEFENDERS_BONUS*(popcount(whitePieces & whiteAttackers & ~blackAttackers) - popcount(blackPieces & blackAttackers & ~whiteAttackers));
+
+  // TODO: positive/negative attack balance penalty/bonus ?
+  int16_t taperedScore = taper(score, board.phase);
+  if(board.phase <= ENDGAME_MAX_PHASE) {
+    int16_t endgameScore;
+    if(evaluateEndgame(board, endgameScore)) {
+      return endgameScore;
+    }
+    taperedScore = static_cast<int32_t>(taperedScore)*getEndgameScale(board, taperedScore >= 0 ? Side::WHITE : Side::BLACK)/ENDGAME_SCALE_NORMAL;
+  }
+  return taperedScore;
+}
+
+int16_t evaluateNnue(const Board& board) {
+  assert(board.network);
+  Side movingSide = board.getMovingSide();
+  Side waitingSide = Board::getOpponentSide(movingSide);
+  // king is attacked on opponents move, after-checkmate
+  Bitboard waitingKing = board.getPieces(waitingSide, PieceType::KING_PIECE);
+  if(waitingKing && board.attackCount[static_cast<uint8_t>(movingSide)][lsb(waitingKing)] > 0) {
+    return AFTER_CHECKMATE_SCORE*Board::getSideSign(movingSide);
+  }
+  int32_t score = propagateNnue(*board.network, board.accumulator[static_cast<uint8_t>(movingSide)], board.accumulator[static_cast<uint8_t>(waitingSide)]);
+  return std::clamp<int32_t>(score, -NNUE_SCORE_LIMIT, NNUE_SCORE_LIMIT)*Board::getSideSign(movingSide);
+}
+
+}
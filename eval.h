@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+
+#include "board.h"
+
+namespace chesseng {
+
+class PawnTable;
+
+constexpr int16_t AFTER_CHECKMATE_SCORE = 10000;
+
+// network evaluation from the board's accumulator, white perspective, the board must have a network set
+int16_t evaluateNnue(const Board& board);
+
+// static evaluation, white perspective, independent of move generation,
+// with the board's network if it has one
+int16_t evaluate(const Board& board);
+
+// pawn structure table used by evaluate on the calling thread, the one set by setPawnTable or one of the thread's own
+PawnTable& getPawnTable();
+// until it is set to nullptr again, the table has to outlive its use on the thread
+void setPawnTable(PawnTable* table);
+
+// material and piece-square terms only, for decisions that need no more than a margin check
+inline int16_t evaluateMaterialPst(const Board& board) {
+  // score and phase are maintained by Board::setSquare
+  return taper(board.pstScore, board.phase);
+}
+
+}
@@ -1,11 +1,17 @@
+#include <algorithm>
 #include <iostream>
 #include <vector>
 #include <sstream>
 #include <string>
+#include <thread>
 
+#include "bench.h"
 #include "board.h"
+#include "kpk.h"
 #include "log.h"
+#include "perft.h"
 #include "test.h"
+#include "timeman.h"
 
 using namespace chesseng;
 
@@ -19,11 +25,13 @@ std::vector<std::string> split(const std::string& input, char delimiter) {
   return res;
 }
 
-std::string EvalStatusToShortString(EvalStatus status){
-  if(status==EvalStatus::DONE_PARTIAL) {
-    return "AB";
-  } else if (status == EvalStatus::DONE_COMPLETE) {
-    return "DC";
+std::string BoundTypeToShortString(BoundType bound){
+  if(bound==BoundType::LOWER) {
+    return "LB";
+  } else if(bound==BoundType::UPPER) {
+    return "UB";
+  } else if (bound == BoundType::EXACT) {
+    return "EX";
   }
   return "NA";
 }
@@ -31,24 +39,83 @@ std::string EvalStatusToShortString(EvalStatus status){
 void handle_uci(){
   loggedcoutline("id name HelloEngine 1 64");
   loggedcoutline("id author lego");
+  std::stringstream ss;
+  ss << "option name Hash type spin default " << DEFAULT_TT_SIZE_MB << " min 1 max 4096";
+  loggedcoutline(ss.str());
+  ss.str("");
+  ss << "option name Threads type spin default 1 min 1 max " << MAX_SEARCH_THREADS;
+  loggedcoutline(ss.str());
+  loggedcoutline("option name ParallelSearch type combo default LazySMP var LazySMP var SplitPoints");
+  loggedcoutline("option name EvalFile type string default <empty>");
+  loggedcoutline("option name UseNNUE type check default false");
+  loggedcoutline("option name Ponder type check default false");
   loggedcoutline("uciok");
 }
 void handle_isready(){
   loggedcoutline("readyok");
 }
-void handle_ucinewgame(){
+// the running search ends with its bestmove, commands that change the engine or the board wait for it
+void stop_search(Engine& engine, std::thread& searchThread) {
+  if(searchThread.joinable()) {
+    engine.stopSearch();
+    searchThread.join();
+  }
+}
+void handle_ucinewgame(Engine& engine){
+  engine.clearHash();
+}
+void handle_setoption(const std::string& input, Engine& engine){
+  std::vector<std::string> params = split(input, ' ');
+  if(params.size() == 5 && params[1] == "name" && params[3] == "value") {
+    if(params[2] == "Hash") {
+      engine.setHashSizeMb(std::max(1, atoi(params[4].c_str())));
+      return;
+    }
+    if(params[2] == "Threads") {
+      engine.setThreads(std::max(1, atoi(params[4].c_str())));
+      return;
+    }
+    if(params[2] == "ParallelSearch") {
+      engine.setParallelSearch(params[4] == "SplitPoints" ? ParallelSearch::SPLIT_POINTS : ParallelSearch::LAZY_SMP);
+      return;
+    }
+    if(params[2] == "EvalFile") {
+      if(!engine.loadNetwork(params[4])) {
+        Log::log("Could not load network: "+params[4]);
+      }
+      return;
+    }
+    if(params[2] == "UseNNUE") {
+      engine.setUseNnue(params[4] == "true");
+      return;
+    }
+    if(params[2] == "Ponder") {
+      // only tells the engine that the GUI may send go ponder
+      return;
+    }
+  }
+  Log::log("Unexpected setoption input: "+input);
 }
 void handle_position(const std::string& input, Board& board){
   static std::string startPositionCommand = "position startpos";
-  static std::string startPositionMovesPrefix = "position startpos moves ";
-  if (input.rfind(startPositionCommand, 0) != 0) {
+  static std::string fenPositionPrefix = "position fen ";
+  static std::string movesPrefix = " moves ";
+  size_t movesStart = input.find(movesPrefix);
+  if (input.rfind(startPositionCommand, 0) == 0) {
+    board = Board();
+    board.startingPosition();
+  } else if (input.rfind(fenPositionPrefix, 0) == 0) {
+    std::string fen = input.substr(fenPositionPrefix.size(), movesStart == std::string::npos ? std::string::npos : movesStart - fenPositionPrefix.size());
+    if(!board.loadFen(fen)) {
+      Log::log("Unexpected fen: "+fen);
+      return;
+    }
+  } else {
     Log::log("Unexpected position input: "+input);
     return;
   }
-  board = Board();
-  board.startingPosition();
-  if(input.rfind(startPositionMovesPrefix, 0) == 0) {
-    std::string movesString = input.substr(startPositionMovesPrefix.size());
+  if(movesStart != std::string::npos) {
+    std::string movesString = input.substr(movesStart + movesPrefix.size());
     std::istringstream sstream(movesString);
     std::string move;
     while (std::getline(sstream, move, ' ')) {
@@ -59,51 +126,90 @@ void handle_position(const std::string& input, Board& board){
     Log::log(boardStr);
   }
 }
-void handle_go(const std::string& input, Engine& engine, const Board& board) {
-  static std::string prefix = "go ";
-  int16_t toDepth = 4;
+// the search runs on searchThread and prints bestmove itself, the input loop stays free for stop, ponderhit and isready
+void handle_go(const std::string& input, Engine& engine, const Board& board, std::thread& searchThread) {
   int16_t toQsDepth = 2;
-  int32_t allowedTimeMs = 5000;
-
-  if(input.size()>prefix.size()) {
-    std::string paramsStr = input.substr(prefix.size());
-    std::vector<std::string> params = split(paramsStr, ' ');
-    for(int i=0;i<params.size();i++){
-      if(params[i] == "depth") {
-        toDepth = atoi(params[i+1].c_str());
-      }
-    }
+  SearchLimits limits = parseGoLimits(input);
+  if(!limits.hasLimit(board.getMovingSide())) {
+    limits.moveTime = DEFAULT_MOVE_TIME_MS;
   }
 
-  Move bestMove = engine.findBestMove(board, toDepth, toQsDepth, allowedTimeMs);
-  std::string bestMoveStr = bestMove.print();
-  // loggedcoutline("bestmove e2e4 ponder e7e6");
-  loggedcoutline("bestmove " + bestMoveStr);
+  stop_search(engine, searchThread);
+  // before the thread starts, a stop right after go must not be cleared by it
+  engine.prepareSearch(limits.infinite || limits.ponder);
+  searchThread = std::thread([&engine, board, limits, toQsDepth]() {
+    Move bestMove = engine.findBestMove(board, limits, toQsDepth);
+    // no legal move: checkmate or stalemate on the board
+    std::string bestMoveStr = "bestmove " + (bestMove.data != 0 ? bestMove.print() : std::string("0000"));
+    std::vector<Move> bestMoves = engine.getBestMoveSequence(board);
+    if(bestMoves.size() > 1 && bestMoves[0].data == bestMove.data) {
+      bestMoveStr += " ponder " + bestMoves[1].print();
+    }
+    loggedcoutline(bestMoveStr);
+  });
 }
 void handle_printboard(const Board& board) {
   Log::logAndPrint(board.logBoard());
 }
 void handle_printmovedetails(const Board& board, Engine& engine) {
   Log::logAndPrint("Moves from current position:");
-  EvalRecord* record = engine.findRecord(board);
-  for(const auto& move:record->moves){
+  EvalRecord record = Engine::evaluateBoard(board);
+  Board nextBoard = board;
+  for(const auto& move:record.moves){
     std::stringstream ss;
-    Board nextBoard = Board::makeMove(board, move);
-    EvalRecord* nextEvalRecord = engine.findRecord(nextBoard);
-    ss<<"- "<<move.print()<< " " << EvalStatusToShortString(nextEvalRecord->evalStatus) <<" score "<< (nextEvalRecord->score/100.0) << " ("<<(nextEvalRecord->minWhite/100.0)<<", "<<(nextEvalRecord->maxBlack/100.0) <<") D"<<(int16_t)nextEvalRecord->evalDepth<< " M"<< nextEvalRecord->moves.size() << " (";
-    for(const auto& seqMove: engine.getBestMoveSequence(nextBoard)){
-      ss<<seqMove.print()<<" ";
+    UndoRecord undo;
+    nextBoard.doMove(move, undo);
+    TTEntry nextEntry;
+    if(!engine.findEntry(nextBoard, nextEntry)) {
+      ss<<"- "<<move.print()<<" NA";
+    } else {
+      ss<<"- "<<move.print()<< " " << BoundTypeToShortString(nextEntry.getBound()) <<" score "<< (nextEntry.score/100.0) << " D"<<(int16_t)nextEntry.depth<< " QD"<<(int16_t)nextEntry.qsDepth << " M"<< Engine::evaluateBoard(nextBoard).moves.size() << " (";
+      for(const auto& seqMove: engine.getBestMoveSequence(nextBoard)){
+        ss<<seqMove.print()<<" ";
+      }
+      ss<<")";
     }
-    ss<<")";
+    nextBoard.undoMove(move, undo);
     Log::logAndPrint(ss.str());
   }
   
 }
 
+// perft <depth> [threads <n>] [hash <mb>], divide also prints the count per root move
+void handle_perft(const std::string& input, const Board& board, bool divide) {
+  std::vector<std::string> params = split(input, ' ');
+  PerftOptions options;
+  options.depth = params.size() > 1 ? atoi(params[1].c_str()) : 1;
+  for(size_t i=2;i+1<params.size();i++){
+    if(params[i] == "threads") {
+      options.threads = std::max(1, atoi(params[i+1].c_str()));
+    } else if(params[i] == "hash") {
+      options.hashSizeMb = std::max(0, atoi(params[i+1].c_str()));
+    }
+  }
+
+  PerftResult result = runPerft(board, options);
+  if(divide) {
+    for(const auto& rootMove : result.rootMoves) {
+      std::stringstream ss;
+      ss << rootMove.first.print() << ": " << rootMove.second;
+      Log::logAndPrint(ss.str());
+    }
+  }
+  std::stringstream ss;
+  ss << "Nodes searched: " << result.nodes << ", " << result.ms << "ms, " << (result.ms > 0 ? result.nodes * 1000 / result.ms : 0) << " nps";
+  Log::logAndPrint(ss.str());
+}
+
 void handle_unknown(const std::string& s) {
   loggedcoutline("Unknown command: " + s);
 }
 
+// endgame evaluation probes it, only the verbs that evaluate or search and the UCI loop generate it
+void init_kpk_bitbase() {
+  initKpkBitbase(std::max(1u, std::thread::hardware_concurrency()));
+}
+
 int main(int argc, char *argv[])
 {
   loggedcoutline("HelloEngine 0");
@@ -114,13 +220,61 @@ int main(int argc, char *argv[])
     std::cout << "Verb " << verb << std::endl;
   }
   if(verb == "test") {
+    init_kpk_bitbase();
     test_all();
     return 0;
   }
+  if(verb == "benchsliders") {
+    bench_sliders();
+    return 0;
+  }
+  if(verb == "benchattackcounts") {
+    bench_attackCounts();
+    return 0;
+  }
+  if(verb == "benchevaluate") {
+    init_kpk_bitbase();
+    bench_evaluate();
+    return 0;
+  }
+
+  if(verb == "benchnnue") {
+    // helloengine benchnnue [network file]
+    bench_nnue(argc > 2 ? argv[2] : "");
+    return 0;
+  }
 
+  if(verb == "benchkpk") {
+    // helloengine benchkpk [max threads]
+    bench_kpk(argc > 2 ? std::max(1, atoi(argv[2])) : 4);
+    return 0;
+  }
+
+  if(verb == "benchsmp") {
+    // helloengine benchsmp [max threads]
+    init_kpk_bitbase();
+    bench_smp(argc > 2 ? std::max(1, atoi(argv[2])) : 4);
+    return 0;
+  }
+
+  if(verb == "benchsearch") {
+    init_kpk_bitbase();
+    bench_search();
+    return 0;
+  }
+  if(verb == "perftsuite") {
+    // helloengine perftsuite [depth] [threads] [hash mb]
+    PerftOptions options;
+    options.threads = argc > 3 ? std::max(1, atoi(argv[3])) : 1;
+    options.hashSizeMb = argc > 4 ? std::max(0, atoi(argv[4])) : 0;
+    return runPerftSuite(argc > 2 ? atoi(argv[2]) : 4, options) ? 0 : 1;
+  }
+
+  init_kpk_bitbase();
   Engine engine;
   Board board;
-  
+  std::thread searchThread;
+
   std::string input;
   for (; std::getline(std::cin, input);) {
     // std::cin >> input;
@@ -130,20 +284,41 @@ int main(int argc, char *argv[])
     } else if (input=="isready") {
       handle_isready();
     } else if (input=="ucinewgame") {
-      handle_ucinewgame();
+      stop_search(engine, searchThread);
+      handle_ucinewgame(engine);
+    } else if(input.rfind("setoption ", 0) == 0) {
+      stop_search(engine, searchThread);
+      handle_setoption(input, engine);
     } else if(input.rfind("position ", 0) == 0) {
+      stop_search(engine, searchThread);
       handle_position(input, board);
     } else if(input == "go" || input.rfind("go ", 0) == 0) {
-      handle_go(input, engine, board);
-    } else if (input == "stop" || input=="xboard") {
+      handle_go(input, engine, board, searchThread);
+    } else if (input == "stop") {
+      stop_search(engine, searchThread);
+    } else if (input == "ponderhit") {
+      engine.ponderhit();
+    } else if (input == "quit") {
+      stop_search(engine, searchThread);
+      break;
+    } else if (input == "xboard") {
       // do nothing
     } else if (input == "pb") {
       handle_printboard(board);
     } else if (input == "pmd") {
+      stop_search(engine, searchThread);
       handle_printmovedetails(board, engine);
+    } else if (input.rfind("perft ", 0) == 0) {
+      stop_search(engine, searchThread);
+      handle_perft(input, board, false);
+    } else if (input.rfind("divide ", 0) == 0) {
+      stop_search(engine, searchThread);
+      handle_perft(input, board, true);
     } else {
       handle_unknown(input);
     }
     
   }
+  // end of piped input: a running search, which may be infinite, ends with its bestmove as on quit
+  stop_search(engine, searchThread);
 }
\ No newline at end of file
@@ -0,0 +1,173 @@
+#include "kpk.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <chrono>
+#include <sstream>
+#include <thread>
+
+#include "log.h"
+
+namespace chesseng {
+namespace {
+// flags, a position's successors are OR-ed together; illegal positions add nothing
+enum KpkResult: uint8_t {
+  KPK_INVALID=0,
+  KPK_UNKNOWN=1,
+  KPK_DRAW=2,
+  KPK_WIN=4
+};
+
+// strong side is 0 in the index
+constexpr uint8_t KPK_STRONG_TO_MOVE = 0;
+constexpr uint8_t KPK_WEAK_TO_MOVE = 1;
+
+inline size_t getKpkIndex(uint8_t sideToMove, uint8_t weakKing, uint8_t strongKing, uint8_t pawn) {
+  return sideToMove | (weakKing << 1) | (strongKing << 7) | ((pawn & 0b111) << 13) | ((6 - (pawn >> 3)) << 15);
+}
+
+struct KpkPosition {
+  explicit KpkPosition(size_t index): sideToMove(index & 1), weakKing((index >> 1) & 0b111111), strongKing((index >> 7) & 0b111111),
+    pawn((6 - (index >> 15))*8 + ((index >> 13) & 0b11)) {}
+  uint8_t sideToMove;
+  uint8_t weakKing;
+  uint8_t strongKing;
+  uint8_t pawn;
+};
+
+const Bitboard* const WHITE_PAWN_ATTACKS = PAWN_ATTACKS[static_cast<uint8_t>(Side::WHITE)].data();
+
+// decided without looking at the successors: illegal, promotion that cannot be stopped, stalemate, pawn lost
+KpkResult classifyLeaf(const KpkPosition& position) {
+  uint8_t pawn = position.pawn;
+  uint8_t promotion = pawn + 8;
+  if(getDistance(position.strongKing, position.weakKing) <= 1 || position.strongKing == pawn || position.weakKing == pawn) {
+    return KPK_INVALID;
+  }
+  if(position.sideToMove == KPK_STRONG_TO_MOVE) {
+    // weak king in check with the strong side to move
+    if(WHITE_PAWN_ATTACKS[pawn] & squareBB(position.weakKing)) {
+      return KPK_INVALID;
+    }
+    if((pawn >> 3) == 6 && position.strongKing != promotion && position.weakKing != promotion
+      && (getDistance(position.weakKing, promotion) > 1 || getDistance(position.strongKing, promotion) == 1)) {
+      return KPK_WIN;
+    }
+    return KPK_UNKNOWN;
+  }
+  Bitboard weakKingMoves = KING_ATTACKS[position.weakKing];
+  if(!(weakKingMoves & ~(KING_ATTACKS[position.strongKing] | WHITE_PAWN_ATTACKS[pawn]))
+    || (weakKingMoves & squareBB(pawn) & ~KING_ATTACKS[position.strongKing])) {
+    return KPK_DRAW;
+  }
+  return KPK_UNKNOWN;
+}
+
+// one retrograde step: the result of the best move for the side to move if it is known already
+KpkResult classify(const KpkPosition& position, const std::vector<uint8_t>& results) {
+  uint8_t found = KPK_INVALID;
+  if(position.sideToMove == KPK_STRONG_TO_MOVE) {
+    Bitboard kingMoves = KING_ATTACKS[position.strongKing];
+    while(kingMoves) {
+      found |= results[getKpkIndex(KPK_WEAK_TO_MOVE, position.weakKing, popLsb(kingMoves), position.pawn)];
+    }
+    // a push to the last row is a win only if classifyLeaf says so, otherwise the new queen is taken
+    uint8_t row = position.pawn >> 3;
+    uint8_t push = position.pawn + 8;
+    if(row < 6 && push != position.strongKing && push != position.weakKing) {
+      found |= results[getKpkIndex(KPK_WEAK_TO_MOVE, position.weakKing, position.strongKing, push)];
+      if(row == 1 && push + 8 != position.strongKing && push + 8 != position.weakKing) {
+        found |= results[getKpkIndex(KPK_WEAK_TO_MOVE, position.weakKing, position.strongKing, push + 8)];
+      }
+    }
+    return found & KPK_WIN ? KPK_WIN : found & KPK_UNKNOWN ? KPK_UNKNOWN : KPK_DRAW;
+  }
+  Bitboard kingMoves = KING_ATTACKS[position.weakKing];
+  while(kingMoves) {
+    found |= results[getKpkIndex(KPK_STRONG_TO_MOVE, popLsb(kingMoves), position.strongKing, position.pawn)];
+  }
+  return found & KPK_DRAW ? KPK_DRAW : found & KPK_UNKNOWN ? KPK_UNKNOWN : KPK_WIN;
+}
+
+// reads the previous iteration only, so ranges of one iteration are independent
+void classifyRange(const std::vector<uint8_t>& results, std::vector<uint8_t>& nextResults, size_t begin, size_t end, bool& changed) {
+  for(size_t index=begin;index<end;index++) {
+    if(results[index] == KPK_UNKNOWN) {
+      nextResults[index] = classify(KpkPosition(index), results);
+      changed |= nextResults[index] != KPK_UNKNOWN;
+    }
+  }
+}
+
+KpkBitbase& getMutableKpkBitbase() {
+  static KpkBitbase bitbase;
+  return bitbase;
+}
+}
+
+void KpkBitbase::generate(size_t threads) {
+  std::vector<uint8_t> results(KPK_INDEX_COUNT);
+  for(size_t index=0;index<KPK_INDEX_COUNT;index++) {
+    results[index] = classifyLeaf(KpkPosition(index));
+  }
+  size_t threadCount = std::max<size_t>(threads, 1);
+  size_t rangeSize = (KPK_INDEX_COUNT + threadCount - 1) / threadCount;
+  std::vector<uint8_t> nextResults = results;
+  // bool vector elements share bytes, one char per thread instead
+  std::vector<char> changed(threadCount, true);
+  while(std::find(changed.begin(), changed.end(), true) != changed.end()) {
+    std::vector<std::thread> workers;
+    for(size_t i=1;i<threadCount;i++) {
+      workers.emplace_back([&, i]() {
+        bool rangeChanged = false;
+        classifyRange(results, nextResults, std::min(i*rangeSize, KPK_INDEX_COUNT), std::min((i+1)*rangeSize, KPK_INDEX_COUNT), rangeChanged);
+        changed[i] = rangeChanged;
+      });
+    }
+    bool rangeChanged = false;
+    classifyRange(results, nextResults, 0, std::min(rangeSize, KPK_INDEX_COUNT), rangeChanged);
+    changed[0] = rangeChanged;
+    for(auto& worker : workers) {
+      worker.join();
+    }
+    results = nextResults;
+  }
+
+  // positions still unknown cannot be won by force
+  bits.assign(KPK_INDEX_COUNT / 64, 0);
+  for(size_t index=0;index<KPK_INDEX_COUNT;index++) {
+    if(results[index] == KPK_WIN) {
+      bits[index / 64] |= 1ULL << (index % 64);
+    }
+  }
+}
+
+bool KpkBitbase::probe(Side strongSide, uint8_t strongKing, uint8_t pawn, uint8_t weakKing, Side movingSide) const {
+  assert(isReady());
+  // white pawn on files a-d
+  uint8_t flip = (strongSide == Side::WHITE ? 0 : 0b111000) | ((pawn & 0b111) >= 4 ? 0b111 : 0);
+  size_t index = getKpkIndex(movingSide == strongSide ? KPK_STRONG_TO_MOVE : KPK_WEAK_TO_MOVE, weakKing ^ flip, strongKing ^ flip, pawn ^ flip);
+  return (bits[index / 64] >> (index % 64)) & 1;
+}
+
+bool KpkBitbase::probe(const Board& board, Side strongSide) const {
+  Side weakSide = Board::getOpponentSide(strongSide);
+  return probe(strongSide, lsb(board.getPieces(strongSide, PieceType::KING_PIECE)), lsb(board.getPieces(strongSide, PieceType::PAWN_PIECE)),
+    lsb(board.getPieces(weakSide, PieceType::KING_PIECE)), board.getMovingSide());
+}
+
+const KpkBitbase& getKpkBitbase() {
+  return getMutableKpkBitbase();
+}
+
+void initKpkBitbase(size_t threads) {
+  KpkBitbase& bitbase = getMutableKpkBitbase();
+  auto startTime = std::chrono::steady_clock::now();
+  bitbase.generate(threads);
+  std::stringstream ss;
+  ss << "KPK bitbase generated with " << threads << " threads in " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count()
+    << "ms, " << bitbase.getSizeBytes() / 1024 << "KB";
+  Log::log(ss.str());
+}
+
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "board.h"
+
+namespace chesseng {
+
+// king and pawn against king, normalized to a white pawn on files a-d:
+// side to move x weak king x strong king x pawn square (rows 2-7, files a-d), one bit per position
+constexpr size_t KPK_INDEX_COUNT = 2*64*64*24;
+
+// won positions of the strong side, everything else (draws and illegal positions) is 0
+class KpkBitbase {
+  public:
+  // retrograde iteration from the mates and promotions, each iteration split over the threads
+  void generate(size_t threads);
+
+  inline bool isReady() const {
+    return !bits.empty();
+  }
+  inline size_t getSizeBytes() const {
+    return bits.size()*sizeof(uint64_t);
+  }
+  inline bool operator==(const KpkBitbase& other) const {
+    return bits == other.bits;
+  }
+
+  // true if strongSide wins with its single pawn, squares as on the board
+  bool probe(Side strongSide, uint8_t strongKing, uint8_t pawn, uint8_t weakKing, Side movingSide) const;
+  bool probe(const Board& board, Side strongSide) const;
+
+  private:
+  std::vector<uint64_t> bits;
+};
+
+// the engine wide bitbase, empty until initKpkBitbase
+const KpkBitbase& getKpkBitbase();
+
+// generates the bitbase in memory, logs the time it took
+void initKpkBitbase(size_t threads);
+
+}
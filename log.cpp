@@ -3,7 +3,7 @@
 namespace chesseng{
 void loggedcoutline(std::string s) {
     Log::log("Out: ["+s+"]");
-    std::cout << s << std::endl;
+    Log::print(s);
 }
 
 }
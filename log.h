@@ -3,21 +3,34 @@
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <mutex>
 
 namespace chesseng {
 class Log {
 
   public:
+  // whole lines, the search and the UCI reader write from their own threads
   static void log(std::string s) {
+    std::lock_guard<std::mutex> lock(mutex());
     filelog() << s << std::endl;
   }
 
-  static void logAndPrint(std::string s) {
+  static void print(std::string s) {
+    std::lock_guard<std::mutex> lock(mutex());
     std::cout << s << std::endl;
+  }
+
+  static void logAndPrint(std::string s) {
+    print(s);
     log(s);
   }
 
   private:
+    static std::mutex& mutex() {
+      static std::mutex logMutex;
+      return logMutex;
+    }
+
     static std::ofstream& filelog() {
       static std::ofstream outfile ("out.txt");
       return outfile;
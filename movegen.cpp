@@ -0,0 +1,174 @@
+#include "movegen.h"
+
+namespace chesseng {
+namespace {
+constexpr uint8_t NO_KING = 64;
+
+// pins and checks of the moving side, computed once per position so only legal moves are registered
+struct MoveLegality {
+  MoveLegality(const Board& board, Side movingSide) {
+    Bitboard kings = board.getPieces(movingSide, PieceType::KING_PIECE);
+    // positions without a king, e.g. in tests, have no check or pin restrictions
+    if(!kings) {
+      return;
+    }
+    kingPos = lsb(kings);
+    checkers = board.getAttackers(kingPos, Board::getOpponentSide(movingSide), board.getOccupancy());
+    pinned = board.getPinned(movingSide, kingPos);
+    if(checkers) {
+      // single check: capture the checker or block, double check: king moves only
+      evasionTargets = (checkers & (checkers - 1)) ? 0 : checkers | BETWEEN[kingPos][lsb(checkers)];
+    }
+  }
+
+  // non-king move keeps the own king safe
+  inline bool isLegal(uint8_t from, uint8_t to) const {
+    return (evasionTargets & squareBB(to)) && (!(pinned & squareBB(from)) || (LINE[kingPos][from] & squareBB(to)));
+  }
+
+  inline Bitboard filterTargets(uint8_t from, Bitboard targets) const {
+    targets &= evasionTargets;
+    if(pinned & squareBB(from)) {
+      targets &= LINE[kingPos][from];
+    }
+    return targets;
+  }
+
+  uint8_t kingPos{NO_KING};
+  Bitboard checkers{0};
+  Bitboard pinned{0};
+  Bitboard evasionTargets{~0ULL};
+};
+
+inline void registerMoves(MoveList& moves, Position fromPosition, Bitboard targets, Bitboard opponentPieces) {
+  while(targets) {
+    uint8_t toPos = popLsb(targets);
+    moves.push_back(Move(fromPosition, Position(toPos), (opponentPieces & squareBB(toPos)) ? MoveFlag::CAPTURE : MoveFlag::QUIET));
+  }
+}
+
+inline void registerPawnMove(MoveList& moves, Position fromPosition, Position toPosition, bool isCapture, bool isPromotion) {
+  if(!isPromotion) {
+    moves.push_back(Move(fromPosition, toPosition, isCapture ? MoveFlag::CAPTURE : MoveFlag::QUIET));
+    return;
+  }
+  for(PieceType promotionType : PROMOTION_PIECES) {
+    moves.push_back(Move(fromPosition, toPosition, getPromotionFlag(promotionType, isCapture)));
+  }
+}
+}
+
+Bitboard getAttackedSquares(const Board& board, Side bySide, Bitboard occupancy) {
+  Bitboard pawns = board.getPieces(bySide, PieceType::PAWN_PIECE);
+  Bitboard attacked = bySide == Side::WHITE
+    ? ((pawns & ~FILE_A_BB) << 7) | ((pawns & ~colBB(7)) << 9)
+    : ((pawns & ~FILE_A_BB) >> 9) | ((pawns & ~colBB(7)) >> 7);
+  for(PieceType pieceType : {PieceType::KNIGHT_PIECE, PieceType::BISHOP_PIECE, PieceType::ROOK_PIECE, PieceType::QUEEN_PIECE}) {
+    for(Bitboard pieces = board.getPieces(bySide, pieceType); pieces; ) {
+      attacked |= getPieceAttacks(pieceType, popLsb(pieces), occupancy);
+    }
+  }
+  for(Bitboard kings = board.getPieces(bySide, PieceType::KING_PIECE); kings; ) {
+    attacked |= KING_ATTACKS[popLsb(kings)];
+  }
+  return attacked;
+}
+
+void generateMoves(const Board& board, MoveList& moves) {
+  Side side = board.getMovingSide();
+  Side opponentSide = Board::getOpponentSide(side);
+  int8_t sideSign = Board::getSideSign(side);
+  Bitboard occupancy = board.getOccupancy();
+  Bitboard ownPieces = board.getOccupancy(side);
+  Bitboard opponentPieces = board.getOccupancy(opponentSide);
+  Bitboard promotionRow = rowBB(side == Side::WHITE ? 7 : 0);
+  MoveLegality legality(board, side);
+
+  // PAWN
+  Bitboard pawns = board.getPieces(side, PieceType::PAWN_PIECE);
+  Bitboard forwardMoves = (side == Side::WHITE ? pawns << 8 : pawns >> 8) & ~occupancy;
+  Bitboard twiceForwardMoves = (side == Side::WHITE ? (forwardMoves & rowBB(2)) << 8 : (forwardMoves & rowBB(5)) >> 8) & ~occupancy;
+  int8_t forwardDelta = 8*sideSign;
+  while(forwardMoves) {
+    uint8_t toPos = popLsb(forwardMoves);
+    if(!legality.isLegal(toPos - forwardDelta, toPos)) {
+      continue;
+    }
+    bool promotionPossible = (squareBB(toPos) & promotionRow) != 0;
+    registerPawnMove(moves, Position(toPos - forwardDelta), Position(toPos), false, promotionPossible);
+  }
+  while(twiceForwardMoves) {
+    uint8_t toPos = popLsb(twiceForwardMoves);
+    if(!legality.isLegal(toPos - 2*forwardDelta, toPos)) {
+      continue;
+    }
+    moves.push_back(Move(Position(toPos - 2*forwardDelta),Position(toPos), MoveFlag::DOUBLE_PAWN_PUSH));
+  }
+
+  for(Bitboard pawnsLeft = pawns; pawnsLeft; ) {
+    uint8_t posIndex = popLsb(pawnsLeft);
+    Bitboard attacks = PAWN_ATTACKS[static_cast<uint8_t>(side)][posIndex];
+    bool promotionPossible = (attacks & promotionRow) != 0;
+    Bitboard captures = legality.filterTargets(posIndex, attacks & opponentPieces);
+    while(captures) {
+      registerPawnMove(moves, Position(posIndex), Position(popLsb(captures)), true, promotionPossible);
+    }
+  }
+
+  // en passant capture
+  int8_t enPassantCol = board.getEnPassantCol();
+  if(enPassantCol != NO_COL) {
+    Position enPassantPos(side == Side::WHITE ? 5 : 2, enPassantCol);
+    Bitboard enPassantPawns = PAWN_ATTACKS[static_cast<uint8_t>(opponentSide)][enPassantPos.data] & pawns;
+    Bitboard capturedPawn = squareBB(Position(enPassantPos.getRow() - sideSign, enPassantCol).data);
+    while(enPassantPawns) {
+      uint8_t fromPos = popLsb(enPassantPawns);
+      // both pawns leave their squares, so check the king directly
+      Bitboard occupancyAfter = (occupancy ^ squareBB(fromPos) ^ capturedPawn) | squareBB(enPassantPos.data);
+      if(legality.kingPos != NO_KING && (board.getAttackers(legality.kingPos, opponentSide, occupancyAfter) & ~capturedPawn)) {
+        continue;
+      }
+      moves.push_back(Move(Position(fromPos), enPassantPos, MoveFlag::EN_PASSANT));
+    }
+  }
+
+  // KNIGHT, BISHOP, ROOK, QUEEN
+  for(PieceType pieceType : {PieceType::KNIGHT_PIECE, PieceType::BISHOP_PIECE, PieceType::ROOK_PIECE, PieceType::QUEEN_PIECE}) {
+    for(Bitboard piecesLeft = board.getPieces(side, pieceType); piecesLeft; ) {
+      uint8_t posIndex = popLsb(piecesLeft);
+      Bitboard targets = getPieceAttacks(pieceType, posIndex, occupancy) & ~ownPieces;
+      registerMoves(moves, Position(posIndex), legality.filterTargets(posIndex, targets), opponentPieces);
+    }
+  }
+
+  // KING
+  if(legality.kingPos == NO_KING) {
+    return;
+  }
+  Position kingPos(legality.kingPos);
+  // the king does not shield squares behind it from a checking slider
+  Bitboard opponentAttacked = getAttackedSquares(board, opponentSide, occupancy ^ squareBB(legality.kingPos));
+  registerMoves(moves, kingPos, KING_ATTACKS[legality.kingPos] & ~ownPieces & ~opponentAttacked, opponentPieces);
+
+  // castling
+  uint8_t shortCastling = side == Side::WHITE ? WHITE_SHORT_CASTLING : BLACK_SHORT_CASTLING;
+  uint8_t longCastling = side == Side::WHITE ? WHITE_LONG_CASTLING : BLACK_LONG_CASTLING;
+  uint8_t castlingRights = board.getCastlingRights() & (shortCastling | longCastling);
+  if(castlingRights && kingPos.getCol() == 4 && !legality.checkers) {
+    Bitboard rooks = board.getPieces(side, PieceType::ROOK_PIECE);
+    uint8_t row = kingPos.getRow();
+    // short castling
+    Bitboard middle = squareBB(kingPos.data+1) | squareBB(kingPos.data+2);
+    if((castlingRights & shortCastling) && (rooks & squareBB(kingPos.data+3)) && !(middle & (occupancy | opponentAttacked))) {
+      moves.push_back(Move(kingPos, Position(row, 6), MoveFlag::KING_CASTLE));
+    }
+    // long castling, king passes d and c files, b file only has to be empty
+    middle = squareBB(kingPos.data-1) | squareBB(kingPos.data-2);
+    Bitboard rookMiddle = middle | squareBB(kingPos.data-3);
+    if((castlingRights & longCastling) && (rooks & squareBB(kingPos.data-4)) && !(rookMiddle & occupancy) && !(middle & opponentAttacked)) {
+      moves.push_back(Move(kingPos, Position(row, 2), MoveFlag::QUEEN_CASTLE));
+    }
+  }
+}
+
+}
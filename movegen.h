@@ -0,0 +1,28 @@
+#pragma once
+
+#include "board.h"
+
+namespace chesseng {
+
+// legal moves of the moving side, pins and checks are resolved during generation
+void generateMoves(const Board& board, MoveList& moves);
+
+// squares attacked by bySide, sliders see through squares missing from occupancy
+Bitboard getAttackedSquares(const Board& board, Side bySide, Bitboard occupancy);
+
+inline Bitboard getPieceAttacks(PieceType pieceType, uint8_t pos, Bitboard occupancy) {
+  switch(pieceType) {
+    case PieceType::KNIGHT_PIECE:
+      return KNIGHT_ATTACKS[pos];
+    case PieceType::BISHOP_PIECE:
+      return bishopAttacks(pos, occupancy);
+    case PieceType::ROOK_PIECE:
+      return rookAttacks(pos, occupancy);
+    case PieceType::QUEEN_PIECE:
+      return queenAttacks(pos, occupancy);
+    default:
+      return 0;
+  }
+}
+
+}
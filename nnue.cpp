@@ -0,0 +1,174 @@
+#include "nnue.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <fstream>
+
+#if SIMD_X86 == 1
+#include <immintrin.h>
+#endif
+
+namespace chesseng {
+namespace {
+typedef int32_t (*PropagateKernel)(const int16_t* moving, const int16_t* waiting, const int8_t* weights);
+
+template<class T>
+bool readValues(std::istream& in, T* values, size_t count) {
+  in.read(reinterpret_cast<char*>(values), count*sizeof(T));
+  return static_cast<bool>(in);
+}
+
+template<class T>
+void writeValues(std::ostream& out, const T* values, size_t count) {
+  out.write(reinterpret_cast<const char*>(values), count*sizeof(T));
+}
+
+int32_t dotScalar(const int16_t* accumulator, const int8_t* weights) {
+  int32_t sum = 0;
+  for(size_t i=0;i<NNUE_HIDDEN;i++) {
+    sum += std::clamp<int16_t>(accumulator[i], 0, NNUE_ACTIVATION_MAX)*weights[i];
+  }
+  return sum;
+}
+
+int32_t propagateScalar(const int16_t* moving, const int16_t* waiting, const int8_t* weights) {
+  return dotScalar(moving, weights) + dotScalar(waiting, weights + NNUE_HIDDEN);
+}
+
+#if SIMD_X86 == 1
+// 16 activations per step, weights widened to int16 for madd
+SIMD_TARGET("sse2")
+int32_t propagateSse2(const int16_t* moving, const int16_t* waiting, const int8_t* weights) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i activationMax = _mm_set1_epi16(NNUE_ACTIVATION_MAX);
+  __m128i sum = zero;
+  for(const int16_t* accumulator : {moving, waiting}) {
+    for(size_t i=0;i<NNUE_HIDDEN;i+=16) {
+      __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(accumulator + i));
+      __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(accumulator + i + 8));
+      low = _mm_min_epi16(_mm_max_epi16(low, zero), activationMax);
+      high = _mm_min_epi16(_mm_max_epi16(high, zero), activationMax);
+      __m128i w = _mm_loadu_si128(reinterpret_cast<const __m128i*>(weights + i));
+      // sign extension: byte into the high half, arithmetic shift back
+      __m128i wLow = _mm_srai_epi16(_mm_unpacklo_epi8(w, w), 8);
+      __m128i wHigh = _mm_srai_epi16(_mm_unpackhi_epi8(w, w), 8);
+      sum = _mm_add_epi32(sum, _mm_add_epi32(_mm_madd_epi16(low, wLow), _mm_madd_epi16(high, wHigh)));
+    }
+    weights += NNUE_HIDDEN;
+  }
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0b01001110));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0b10110001));
+  return _mm_cvtsi128_si32(sum);
+}
+
+// 32 activations per step as unsigned bytes, uint8 x int8 products in pairs
+SIMD_TARGET("avx2")
+int32_t propagateAvx2(const int16_t* moving, const int16_t* waiting, const int8_t* weights) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i activationMax = _mm256_set1_epi16(NNUE_ACTIVATION_MAX);
+  const __m256i ones = _mm256_set1_epi16(1);
+  __m256i sum = zero;
+  for(const int16_t* accumulator : {moving, waiting}) {
+    for(size_t i=0;i<NNUE_HIDDEN;i+=32) {
+      __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(accumulator + i));
+      __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(accumulator + i + 16));
+      low = _mm256_min_epi16(_mm256_max_epi16(low, zero), activationMax);
+      high = _mm256_min_epi16(_mm256_max_epi16(high, zero), activationMax);
+      // pack works per 128-bit lane, the permute puts the activations back in order
+      __m256i activations = _mm256_permute4x64_epi64(_mm256_packus_epi16(low, high), 0b11011000);
+      __m256i w = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(weights + i));
+      // pair sums stay below 2*127*128, no saturation
+      sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_maddubs_epi16(activations, w), ones));
+    }
+    weights += NNUE_HIDDEN;
+  }
+  __m128i halves = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+  halves = _mm_add_epi32(halves, _mm_shuffle_epi32(halves, 0b01001110));
+  halves = _mm_add_epi32(halves, _mm_shuffle_epi32(halves, 0b10110001));
+  return _mm_cvtsi128_si32(halves);
+}
+#endif
+
+PropagateKernel getPropagateKernel(SimdLevel level) {
+  switch(level) {
+    #if SIMD_X86 == 1
+    case SimdLevel::AVX512:
+    case SimdLevel::AVX2:
+      return propagateAvx2;
+    case SimdLevel::SSE2:
+      return propagateSse2;
+    #endif
+    default:
+      return propagateScalar;
+  }
+}
+
+const PropagateKernel PROPAGATE_KERNEL = getPropagateKernel(getSimdLevel());
+
+inline int32_t scaleOutput(const NnueNetwork& network, int32_t sum) {
+  return (sum + network.outputBias) * NNUE_OUTPUT_SCALE / (NNUE_ACTIVATION_MAX * NNUE_WEIGHT_SCALE);
+}
+}
+
+bool NnueNetwork::load(std::istream& in) {
+  std::array<uint32_t, 4> header;
+  if(!readValues(in, header.data(), header.size()) || header != std::array<uint32_t, 4>{NNUE_FILE_MAGIC, NNUE_FILE_VERSION, NNUE_FEATURES, NNUE_HIDDEN}) {
+    return false;
+  }
+  NnueNetwork loaded;
+  if(!readValues(in, loaded.featureWeights.data(), loaded.featureWeights.size())
+    || !readValues(in, loaded.featureBias.data(), loaded.featureBias.size())
+    || !readValues(in, loaded.outputWeights.data(), loaded.outputWeights.size())
+    || !readValues(in, &loaded.outputBias, 1)) {
+    return false;
+  }
+  *this = std::move(loaded);
+  return true;
+}
+
+bool NnueNetwork::loadFile(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  return in && load(in);
+}
+
+void NnueNetwork::save(std::ostream& out) const {
+  std::array<uint32_t, 4> header{NNUE_FILE_MAGIC, NNUE_FILE_VERSION, NNUE_FEATURES, NNUE_HIDDEN};
+  writeValues(out, header.data(), header.size());
+  writeValues(out, featureWeights.data(), featureWeights.size());
+  writeValues(out, featureBias.data(), featureBias.size());
+  writeValues(out, outputWeights.data(), outputWeights.size());
+  writeValues(out, &outputBias, 1);
+}
+
+NnueNetwork NnueNetwork::random(uint64_t seed) {
+  NnueNetwork network;
+  uint64_t state = seed | 1;
+  auto next = [&state]() {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+  };
+  // a few dozen pieces keep most accumulator values inside the clipped range
+  for(int16_t& weight : network.featureWeights) {
+    weight = static_cast<int16_t>(next() % 17) - 8;
+  }
+  for(int16_t& bias : network.featureBias) {
+    bias = static_cast<int16_t>(next() % 64) + 32;
+  }
+  for(int8_t& weight : network.outputWeights) {
+    weight = static_cast<int8_t>(next() % 65) - 32;
+  }
+  return network;
+}
+
+int32_t propagateNnue(const NnueNetwork& network, const std::array<int16_t, NNUE_HIDDEN>& moving, const std::array<int16_t, NNUE_HIDDEN>& waiting) {
+  return scaleOutput(network, PROPAGATE_KERNEL(moving.data(), waiting.data(), network.outputWeights.data()));
+}
+
+int32_t propagateNnue(const NnueNetwork& network, const std::array<int16_t, NNUE_HIDDEN>& moving, const std::array<int16_t, NNUE_HIDDEN>& waiting, SimdLevel level) {
+  assert(level <= getSimdLevel());
+  return scaleOutput(network, getPropagateKernel(level)(moving.data(), waiting.data(), network.outputWeights.data()));
+}
+
+}
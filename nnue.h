@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "attackcount.h"
+
+namespace chesseng {
+
+// efficiently updatable network: 768 piece-square inputs per perspective -> NNUE_HIDDEN accumulator,
+// clipped to [0, NNUE_ACTIVATION_MAX], both halves (moving side first) -> one output
+constexpr size_t NNUE_FEATURES = 2*6*64;
+constexpr size_t NNUE_HIDDEN = 256;
+constexpr int16_t NNUE_ACTIVATION_MAX = 127;
+// output weight w stands for w / NNUE_WEIGHT_SCALE, activation a for a / NNUE_ACTIVATION_MAX
+constexpr int32_t NNUE_WEIGHT_SCALE = 64;
+// network output 1.0 in centipawns
+constexpr int32_t NNUE_OUTPUT_SCALE = 400;
+
+// file layout, little endian: magic, version, feature count, hidden size,
+// feature weights [feature][hidden] int16, feature bias int16, output weights int8, output bias int32
+constexpr uint32_t NNUE_FILE_MAGIC = 0x45554e4e;
+constexpr uint32_t NNUE_FILE_VERSION = 1;
+
+// one row per perspective side, empty without a network: only boards that evaluate with one carry the rows
+typedef std::vector<std::array<int16_t, NNUE_HIDDEN>> NnueAccumulator;
+
+// input of a piece seen from a side: own pieces first, board mirrored for black
+inline size_t getNnueFeature(uint8_t perspective, uint8_t pieceType, uint8_t pieceSide, uint8_t pos) {
+  uint8_t relativeSide = pieceSide == perspective ? 0 : 1;
+  uint8_t relativePos = perspective == 0 ? pos : pos ^ 0b111000;
+  return (relativeSide*6 + pieceType - 1)*64 + relativePos;
+}
+
+struct NnueNetwork {
+  std::vector<int16_t> featureWeights = std::vector<int16_t>(NNUE_FEATURES*NNUE_HIDDEN);
+  std::array<int16_t, NNUE_HIDDEN> featureBias{};
+  std::array<int8_t, 2*NNUE_HIDDEN> outputWeights{};
+  int32_t outputBias{0};
+
+  inline const int16_t* getFeatureWeights(size_t feature) const {
+    return featureWeights.data() + feature*NNUE_HIDDEN;
+  }
+
+  // false on a stream of the wrong layout, the network is left unchanged then
+  bool load(std::istream& in);
+  bool loadFile(const std::string& path);
+  void save(std::ostream& out) const;
+
+  // small random weights, for tests and benchmarks without a trained network
+  static NnueNetwork random(uint64_t seed);
+};
+
+// accumulator column updates, called from Board::setSquare, no aliasing lets the compiler vectorize them
+inline void addNnueFeature(std::array<int16_t, NNUE_HIDDEN>& accumulator, const int16_t* __restrict weights) {
+  int16_t* __restrict values = accumulator.data();
+  for(size_t i=0;i<NNUE_HIDDEN;i++) {
+    values[i] += weights[i];
+  }
+}
+
+inline void subNnueFeature(std::array<int16_t, NNUE_HIDDEN>& accumulator, const int16_t* __restrict weights) {
+  int16_t* __restrict values = accumulator.data();
+  for(size_t i=0;i<NNUE_HIDDEN;i++) {
+    values[i] -= weights[i];
+  }
+}
+
+// network output for the moving side from a ready accumulator, centipawns,
+// int8 dot product kernel for the SIMD level picked at startup
+int32_t propagateNnue(const NnueNetwork& network, const std::array<int16_t, NNUE_HIDDEN>& moving, const std::array<int16_t, NNUE_HIDDEN>& waiting);
+
+// level must not exceed getSimdLevel()
+int32_t propagateNnue(const NnueNetwork& network, const std::array<int16_t, NNUE_HIDDEN>& moving, const std::array<int16_t, NNUE_HIDDEN>& waiting, SimdLevel level);
+
+}
@@ -0,0 +1,157 @@
+#include "pawns.h"
+
+#include <algorithm>
+
+namespace chesseng {
+namespace {
+constexpr PstScore DOUBLED_PAWN_PENALTY{-10, -20};
+constexpr PstScore ISOLATED_PAWN_PENALTY{-10, -15};
+constexpr PstScore BACKWARD_PAWN_PENALTY{-8, -10};
+// by row counted from the own side
+constexpr std::array<PstScore, 8> PASSED_PAWN_BONUS{{{0, 0}, {0, 5}, {5, 10}, {10, 20}, {20, 35}, {35, 60}, {60, 100}, {0, 0}}};
+// own pawns one and two rows in front of the king, king on the first two rows only
+constexpr PstScore PAWN_SHIELD_NEAR_BONUS{12, 0};
+constexpr PstScore PAWN_SHIELD_FAR_BONUS{6, 0};
+
+struct PawnMasks {
+  // same file, rows in front of the pawn
+  std::array<std::array<Bitboard, 64>, 2> forward{};
+  // same and adjacent files, rows in front of the pawn
+  std::array<std::array<Bitboard, 64>, 2> passed{};
+  // adjacent files, same row and behind the pawn
+  std::array<std::array<Bitboard, 64>, 2> support{};
+  std::array<Bitboard, 8> adjacentFiles{};
+};
+
+constexpr PawnMasks generatePawnMasks() {
+  PawnMasks masks;
+  for(uint8_t col=0;col<8;col++) {
+    masks.adjacentFiles[col] = (col > 0 ? colBB(col-1) : 0) | (col < 7 ? colBB(col+1) : 0);
+  }
+  for(uint8_t pos=0;pos<64;pos++) {
+    uint8_t row = pos >> 3;
+    uint8_t col = pos & 0b111;
+    Bitboard rowsAbove = 0;
+    Bitboard rowsBelow = 0;
+    for(uint8_t otherRow=0;otherRow<8;otherRow++) {
+      if(otherRow > row) {
+        rowsAbove |= rowBB(otherRow);
+      } else if(otherRow < row) {
+        rowsBelow |= rowBB(otherRow);
+      }
+    }
+    masks.forward[0][pos] = colBB(col) & rowsAbove;
+    masks.forward[1][pos] = colBB(col) & rowsBelow;
+    masks.passed[0][pos] = (colBB(col) | masks.adjacentFiles[col]) & rowsAbove;
+    masks.passed[1][pos] = (colBB(col) | masks.adjacentFiles[col]) & rowsBelow;
+    masks.support[0][pos] = masks.adjacentFiles[col] & ~rowsAbove;
+    masks.support[1][pos] = masks.adjacentFiles[col] & ~rowsBelow;
+  }
+  return masks;
+}
+
+constexpr PawnMasks PAWN_MASKS = generatePawnMasks();
+
+PstScore evaluateSidePawns(Side side, Bitboard ownPawns, Bitboard opponentPawns, Bitboard& passed) {
+  uint8_t sideIndex = static_cast<uint8_t>(side);
+  PstScore score;
+  for(Bitboard pawnsLeft = ownPawns; pawnsLeft; ) {
+    uint8_t pos = popLsb(pawnsLeft);
+    uint8_t row = pos >> 3;
+    uint8_t ownRow = side == Side::WHITE ? row : 7 - row;
+    bool doubled = (PAWN_MASKS.forward[sideIndex][pos] & ownPawns) != 0;
+    bool isolated = !(PAWN_MASKS.adjacentFiles[pos & 0b111] & ownPawns);
+    if(doubled) {
+      score += DOUBLED_PAWN_PENALTY;
+    }
+    if(isolated) {
+      score += ISOLATED_PAWN_PENALTY;
+    } else if(ownRow < 7 && !(PAWN_MASKS.support[sideIndex][pos] & ownPawns)) {
+      // no pawn can come up to defend it and the square in front is controlled by an opponent pawn
+      uint8_t stopPos = side == Side::WHITE ? pos + 8 : pos - 8;
+      if(PAWN_ATTACKS[sideIndex][stopPos] & opponentPawns) {
+        score += BACKWARD_PAWN_PENALTY;
+      }
+    }
+    if(!doubled && !(PAWN_MASKS.passed[sideIndex][pos] & opponentPawns)) {
+      passed |= squareBB(pos);
+      score += PASSED_PAWN_BONUS[ownRow];
+    }
+  }
+  return score;
+}
+}
+
+void evaluatePawnStructure(const Board& board, PawnEntry& entry) {
+  Bitboard whitePawns = board.getPieces(Side::WHITE, PieceType::PAWN_PIECE);
+  Bitboard blackPawns = board.getPieces(Side::BLACK, PieceType::PAWN_PIECE);
+  entry.passed = {0, 0};
+  entry.structure = evaluateSidePawns(Side::WHITE, whitePawns, blackPawns, entry.passed[0]);
+  entry.structure -= evaluateSidePawns(Side::BLACK, blackPawns, whitePawns, entry.passed[1]);
+}
+
+PstScore evaluateKingShield(const Board& board, Side side) {
+  PstScore score;
+  Bitboard kings = board.getPieces(side, PieceType::KING_PIECE);
+  if(!kings) {
+    return score;
+  }
+  uint8_t kingPos = lsb(kings);
+  uint8_t kingRow = kingPos >> 3;
+  uint8_t ownRow = side == Side::WHITE ? kingRow : 7 - kingRow;
+  if(ownRow > 1) {
+    return score;
+  }
+  Bitboard files = colBB(kingPos & 0b111) | PAWN_MASKS.adjacentFiles[kingPos & 0b111];
+  Bitboard pawns = board.getPieces(side, PieceType::PAWN_PIECE) & files;
+  int8_t direction = side == Side::WHITE ? 1 : -1;
+  Bitboard nearRow = rowBB(kingRow + direction);
+  Bitboard farRow = rowBB(kingRow + 2*direction);
+  score += PAWN_SHIELD_NEAR_BONUS*popcount(pawns & nearRow);
+  score += PAWN_SHIELD_FAR_BONUS*popcount(pawns & farRow);
+  return score;
+}
+
+PawnTable::PawnTable(size_t entryCount) {
+  size_t size = 1;
+  while(size * 2 <= entryCount) {
+    size *= 2;
+  }
+  entries.resize(size);
+  mask = size - 1;
+}
+
+void PawnTable::clear() {
+  std::fill(entries.begin(), entries.end(), PawnEntry());
+  resetStats();
+}
+
+const PawnEntry& PawnTable::probe(const Board& board) {
+  PawnEntry& entry = entries[board.pawnKey & mask];
+  stats.probes++;
+  // a fresh entry has key 0 and score 0, which is also right for a board without pawns
+  if(entry.key == board.pawnKey) {
+    stats.hits++;
+  } else {
+    entry.key = board.pawnKey;
+    evaluatePawnStructure(board, entry);
+    entry.kingPos = {64, 64};
+  }
+
+  std::array<uint8_t, 2> kingPos{64, 64};
+  for(Side side : {Side::WHITE, Side::BLACK}) {
+    Bitboard kings = board.getPieces(side, PieceType::KING_PIECE);
+    kingPos[static_cast<uint8_t>(side)] = kings ? lsb(kings) : 64;
+  }
+  if(kingPos != entry.kingPos) {
+    if(entry.kingPos[0] != 64) {
+      stats.shieldUpdates++;
+    }
+    entry.kingPos = kingPos;
+    entry.shield = evaluateKingShield(board, Side::WHITE);
+    entry.shield -= evaluateKingShield(board, Side::BLACK);
+  }
+  return entry;
+}
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "board.h"
+
+namespace chesseng {
+
+constexpr size_t DEFAULT_PAWN_TABLE_ENTRIES = 1 << 14;
+
+// pawn structure of one pawn configuration, king shield for the king squares it was computed with
+struct PawnEntry {
+  uint64_t key{0};
+  // doubled, isolated, backward and passed pawns, white perspective
+  PstScore structure;
+  // passed pawns by side
+  std::array<Bitboard, 2> passed{0, 0};
+  // king positions of the shield score, 64 if not computed yet
+  std::array<uint8_t, 2> kingPos{64, 64};
+  PstScore shield;
+};
+
+struct PawnTableStats {
+  uint64_t probes{0};
+  uint64_t hits{0};
+  // shield recomputed on a structure hit after a king move
+  uint64_t shieldUpdates{0};
+};
+
+// direct mapped, always replaces, one per search thread
+class PawnTable {
+  public:
+  explicit PawnTable(size_t entryCount = DEFAULT_PAWN_TABLE_ENTRIES);
+
+  // pawn structure and king shield score, computed on a miss
+  const PawnEntry& probe(const Board& board);
+
+  void clear();
+  inline const PawnTableStats& getStats() const {
+    return stats;
+  }
+  inline void resetStats() {
+    stats = PawnTableStats();
+  }
+  inline size_t getSizeBytes() const {
+    return entries.size() * sizeof(PawnEntry);
+  }
+
+  private:
+  std::vector<PawnEntry> entries;
+  uint64_t mask;
+  PawnTableStats stats;
+};
+
+// full pawn structure evaluation, what the table caches
+void evaluatePawnStructure(const Board& board, PawnEntry& entry);
+PstScore evaluateKingShield(const Board& board, Side side);
+
+}
@@ -0,0 +1,175 @@
+#include "perft.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <thread>
+
+#include "log.h"
+#include "movegen.h"
+
+namespace chesseng {
+namespace {
+struct PerftEntry {
+  uint64_t key{0};
+  // leaf count << 8 | depth, 0 for an empty entry
+  uint64_t countDepth{0};
+};
+
+// subtree leaf counts by position and depth, always replaces
+class PerftTable {
+  public:
+  explicit PerftTable(size_t sizeMb) {
+    size_t entryCount = 1;
+    while(entryCount * 2 * sizeof(PerftEntry) <= sizeMb * 1024 * 1024) {
+      entryCount *= 2;
+    }
+    entries.resize(sizeMb > 0 ? entryCount : 0);
+    mask = entryCount - 1;
+  }
+
+  inline bool enabled() const {
+    return !entries.empty();
+  }
+
+  inline bool probe(uint64_t key, uint8_t depth, uint64_t& count) const {
+    const PerftEntry& entry = entries[key & mask];
+    if(entry.key == key && (entry.countDepth & 0xff) == depth) {
+      count = entry.countDepth >> 8;
+      return true;
+    }
+    return false;
+  }
+
+  inline void store(uint64_t key, uint8_t depth, uint64_t count) {
+    PerftEntry& entry = entries[key & mask];
+    entry.key = key;
+    entry.countDepth = (count << 8) | depth;
+  }
+
+  private:
+  std::vector<PerftEntry> entries;
+  uint64_t mask{0};
+};
+
+uint64_t perft(Board& board, uint8_t depth, PerftTable& table) {
+  if(depth == 0) {
+    return 1;
+  }
+  uint64_t count = 0;
+  if(table.enabled() && depth > 1 && table.probe(board.hash, depth, count)) {
+    return count;
+  }
+
+  MoveList moves;
+  generateMoves(board, moves);
+  // bulk counting, leaf positions are not visited
+  if(depth == 1) {
+    return moves.size();
+  }
+  for(const Move& move : moves) {
+    UndoRecord undo;
+    board.doMove<false>(move, undo);
+    count += perft(board, depth - 1, table);
+    board.undoMove<false>(move, undo);
+  }
+
+  if(table.enabled()) {
+    table.store(board.hash, depth, count);
+  }
+  return count;
+}
+}
+
+const std::vector<PerftPosition> PERFT_SUITE = {
+  {"startpos", "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", {20, 400, 8902, 197281, 4865609, 119060324}},
+  {"kiwipete", "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", {48, 2039, 97862, 4085603, 193690690}},
+  {"position3", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", {14, 191, 2812, 43238, 674624, 11030083}},
+  {"position4", "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", {6, 264, 9467, 422333, 15833292}},
+  {"position5", "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", {44, 1486, 62379, 2103487, 89941194}},
+  {"position6", "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10", {46, 2079, 89890, 3894594, 164075551}}
+};
+
+uint64_t perft(Board& board, uint8_t depth) {
+  PerftTable noTable(0);
+  return perft(board, depth, noTable);
+}
+
+PerftResult runPerft(const Board& board, const PerftOptions& options) {
+  auto startTime = std::chrono::steady_clock::now();
+  PerftResult result;
+  Board rootBoard = board;
+  MoveList rootMoves;
+  generateMoves(rootBoard, rootMoves);
+  for(const Move& move : rootMoves) {
+    result.rootMoves.push_back({move, options.depth > 0 ? 0 : 1});
+  }
+
+  // threads take the next unsearched root move
+  std::atomic<size_t> nextRootMove{0};
+  size_t threadCount = std::max<size_t>(options.threads, 1);
+  auto worker = [&]() {
+    // split between the threads, at least 1MB each so a small hash is not silently off
+    PerftTable table(options.hashSizeMb > 0 ? std::max<size_t>(options.hashSizeMb / threadCount, 1) : 0);
+    Board threadBoard = board;
+    for(size_t i = nextRootMove++; i < result.rootMoves.size(); i = nextRootMove++) {
+      if(options.depth == 0) {
+        continue;
+      }
+      Move move = result.rootMoves[i].first;
+      UndoRecord undo;
+      threadBoard.doMove<false>(move, undo);
+      result.rootMoves[i].second = perft(threadBoard, options.depth - 1, table);
+      threadBoard.undoMove<false>(move, undo);
+    }
+  };
+  std::vector<std::thread> threads;
+  for(size_t i=1;i<threadCount;i++) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for(auto& thread : threads) {
+    thread.join();
+  }
+
+  for(const auto& rootMove : result.rootMoves) {
+    result.nodes += rootMove.second;
+  }
+  if(options.depth == 0) {
+    result.nodes = 1;
+  }
+  result.ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+  return result;
+}
+
+bool runPerftSuite(uint8_t maxDepth, const PerftOptions& options) {
+  bool allPassed = true;
+  uint64_t totalNodes = 0;
+  int64_t totalMs = 0;
+  for(const PerftPosition& position : PERFT_SUITE) {
+    Board board;
+    board.loadFen(position.fen);
+    for(uint8_t depth=1;depth<=std::min<size_t>(maxDepth, position.counts.size());depth++) {
+      PerftOptions depthOptions = options;
+      depthOptions.depth = depth;
+      PerftResult result = runPerft(board, depthOptions);
+      bool passed = result.nodes == position.counts[depth-1];
+      allPassed = allPassed && passed;
+      totalNodes += result.nodes;
+      totalMs += result.ms;
+
+      std::stringstream ss;
+      ss << position.name << " depth " << (int)depth << ": " << result.nodes << " nodes, expected " << position.counts[depth-1]
+        << (passed ? " OK" : " FAILED") << ", " << result.ms << "ms";
+      Log::logAndPrint(ss.str());
+    }
+  }
+  std::stringstream ss;
+  ss << "Perft suite " << (allPassed ? "passed" : "FAILED") << ": " << totalNodes << " nodes, " << totalMs << "ms, "
+    << (totalMs > 0 ? totalNodes * 1000 / totalMs : 0) << " nps";
+  Log::logAndPrint(ss.str());
+  return allPassed;
+}
+
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "board.h"
+
+namespace chesseng {
+
+struct PerftOptions {
+  uint8_t depth{1};
+  // root moves are split between threads
+  size_t threads{1};
+  // transposition table for subtree counts, 0 disables it; one per thread, at least 1MB each
+  size_t hashSizeMb{0};
+};
+
+struct PerftResult {
+  uint64_t nodes{0};
+  int64_t ms{0};
+  // leaf count per root move, for divide
+  std::vector<std::pair<Move, uint64_t>> rootMoves;
+};
+
+// positions with known leaf counts, counts[i] is perft(i+1)
+struct PerftPosition {
+  std::string name;
+  std::string fen;
+  std::vector<uint64_t> counts;
+};
+
+extern const std::vector<PerftPosition> PERFT_SUITE;
+
+uint64_t perft(Board& board, uint8_t depth);
+PerftResult runPerft(const Board& board, const PerftOptions& options);
+// runs every suite position up to maxDepth, returns false on a count mismatch
+bool runPerftSuite(uint8_t maxDepth, const PerftOptions& options);
+
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+#include "bitboard.h"
+
+namespace chesseng {
+
+// midgame and endgame halves of a score, white perspective
+struct PstScore {
+  int16_t mg{0};
+  int16_t eg{0};
+
+  constexpr PstScore& operator+=(PstScore rhs) {
+    mg += rhs.mg;
+    eg += rhs.eg;
+    return *this;
+  }
+  constexpr PstScore& operator-=(PstScore rhs) {
+    mg -= rhs.mg;
+    eg -= rhs.eg;
+    return *this;
+  }
+};
+
+constexpr PstScore operator*(PstScore score, int16_t factor) {
+  return PstScore{static_cast<int16_t>(score.mg*factor), static_cast<int16_t>(score.eg*factor)};
+}
+
+inline bool operator==(PstScore lhs, PstScore rhs) {
+  return lhs.mg == rhs.mg && lhs.eg == rhs.eg;
+}
+
+// indexed by piece type: no piece, pawn, rook, knight, bishop, queen, king
+constexpr std::array<int16_t,7> MG_PIECE_VALUE{0, 100, 500, 300, 300, 900, 20000};
+constexpr std::array<int16_t,7> EG_PIECE_VALUE{0, 120, 520, 280, 310, 900, 20000};
+
+// game phase weight of the pieces left on the board, MAX_PHASE for the starting material
+constexpr std::array<uint8_t,7> PHASE_WEIGHT{0, 0, 2, 1, 1, 4, 0};
+constexpr int16_t MAX_PHASE = 24;
+
+// midgame half at MAX_PHASE, endgame half at 0, more material than at the start counts as MAX_PHASE
+inline int16_t taper(PstScore score, uint8_t phase) {
+  int32_t mgPhase = std::min<int32_t>(phase, MAX_PHASE);
+  return (score.mg*mgPhase + score.eg*(MAX_PHASE - mgPhase)) / MAX_PHASE;
+}
+
+constexpr int16_t MG_PAWN_ROW_PROGRESS_BONUS = 20;
+constexpr int16_t EG_PAWN_ROW_PROGRESS_BONUS = 30;
+constexpr int16_t CENTER_BONUS = 20;
+constexpr int16_t NEAR_CENTER_BONUS = 10;
+// king stays away from the centre while there are pieces to attack it, walks to it once they are traded
+constexpr int16_t MG_KING_CENTER_PENALTY = -20;
+constexpr int16_t MG_KING_NEAR_CENTER_PENALTY = -10;
+constexpr int16_t EG_KING_CENTER_BONUS = 30;
+constexpr int16_t EG_KING_NEAR_CENTER_BONUS = 15;
+
+// material and piece-square terms, indexed by square data (piece type and side) and position,
+// black entries are mirrored and negated, empty square is zero
+constexpr std::array<std::array<PstScore, 64>, 16> generatePst() {
+  std::array<std::array<PstScore, 64>, 16> pst{};
+  for(uint8_t pieceType=1;pieceType<7;pieceType++) {
+    bool isPawn = pieceType == 1;
+    bool isKing = pieceType == 6;
+    for(uint8_t pos=0;pos<64;pos++) {
+      PstScore score{MG_PIECE_VALUE[pieceType], EG_PIECE_VALUE[pieceType]};
+      if(isPawn) {
+        int16_t rowProgress = (pos >> 3) - 1;
+        score.mg += rowProgress*MG_PAWN_ROW_PROGRESS_BONUS;
+        score.eg += rowProgress*EG_PAWN_ROW_PROGRESS_BONUS;
+      }
+      if(CENTER_BB & squareBB(pos)) {
+        score.mg += isKing ? MG_KING_CENTER_PENALTY : CENTER_BONUS;
+        score.eg += isKing ? EG_KING_CENTER_BONUS : CENTER_BONUS;
+      }
+      if(NEAR_CENTER_BB & squareBB(pos)) {
+        score.mg += isKing ? MG_KING_NEAR_CENTER_PENALTY : NEAR_CENTER_BONUS;
+        score.eg += isKing ? EG_KING_NEAR_CENTER_BONUS : NEAR_CENTER_BONUS;
+      }
+      pst[pieceType][pos] = score;
+      // black piece: side bit set, row mirrored
+      uint8_t mirroredPos = pos ^ 0b111000;
+      pst[pieceType | 0b1000][mirroredPos] = PstScore{static_cast<int16_t>(-score.mg), static_cast<int16_t>(-score.eg)};
+    }
+  }
+  return pst;
+}
+
+inline constexpr std::array<std::array<PstScore, 64>, 16> PST = generatePst();
+
+}
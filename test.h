@@ -1,14 +1,27 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <assert.h>
+#include <atomic>
 #include <iostream>
+#include <sstream>
 #include <vector>
 #include <string>
+#include <thread>
 
+#include "attackcount.h"
 #include "board.h"
+#include "endgame.h"
 #include "engine.h"
+#include "eval.h"
+#include "kpk.h"
 #include "log.h"
+#include "movegen.h"
+#include "nnue.h"
+#include "pawns.h"
+#include "perft.h"
+#include "workpool.h"
 
 namespace chesseng {
 void test_boardEvalPawnRook() {
@@ -47,6 +60,52 @@ void test_boardEvalAfterCheckmate() {
   assert(record.evalStatus==EvalStatus::DONE_COMPLETE);
 }
 
+void test_legalMoves() {
+  // checkmate: no legal moves while in check
+  Board board;
+  board.loadFen("rnb1kbnr/pppp1ppp/8/4p3/6Pq/5P2/PPPPP2P/RNBQKBNR w KQkq - 1 3");
+  EvalRecord record = Engine::evaluateBoard(board);
+  assert(record.moves.size() == 0 && record.score < -2000);
+
+  // pinned knight cannot block the check, king cannot step back along the checking row
+  board.loadFen("4k3/8/8/b7/8/8/3N4/4K2r w - - 0 1");
+  record = Engine::evaluateBoard(board);
+  assert(record.moves.size() == 2);
+  for(const Move& move : record.moves) {
+    assert(move.getFrom().data == Position(0,4).data);
+  }
+
+  // en passant capture would expose the king along the row
+  board.loadFen("8/8/8/KPp4r/8/8/8/7k w - c6 0 2");
+  assert(board.getEnPassantCol() == 2);
+  record = Engine::evaluateBoard(board);
+  for(const Move& move : record.moves) {
+    assert(move.getFlag() != MoveFlag::EN_PASSANT);
+  }
+  assert(record.moves.size() == 3 + 1);
+}
+
+void test_evaluateWithoutMoves() {
+  // symmetric position, no move generation needed for a score
+  Board board;
+  board.startingPosition();
+  assert(evaluateMaterialPst(board) == 0);
+  assert(evaluate(board) == 0);
+
+  // static eval matches the combined record for a position with moves
+  board.loadFen(PERFT_SUITE[1].fen);
+  EvalRecord record = Engine::evaluateBoard(board);
+  assert(record.evalStatus == EvalStatus::DONE_COMPLETE && record.score == evaluate(board));
+  MoveList moves;
+  generateMoves(board, moves);
+  assert(moves.size() == record.moves.size() && moves.size() == PERFT_SUITE[1].counts[0]);
+
+  // material and piece-square terms only, mostly the endgame half with a single rook
+  board.loadFen("4k3/8/8/8/8/8/8/R3K3 w - - 0 1");
+  uint8_t rook = static_cast<uint8_t>(PieceType::ROOK_PIECE);
+  assert(evaluateMaterialPst(board) == taper(PstScore{MG_PIECE_VALUE[rook], EG_PIECE_VALUE[rook]}, PHASE_WEIGHT[rook]));
+}
+
 void test_boardEvalPawnBishop() {
   Board board;
   board.setSquare(Position(0,0),Square(PieceType::PAWN_PIECE, SideBit::WHITE));
@@ -80,15 +139,16 @@ void test_moveCastling(){
   board.setSquare(Position(0,7),Square(PieceType::ROOK_PIECE, SideBit::WHITE));
   board.setSquare(Position(0,4),Square(PieceType::KING_PIECE, SideBit::WHITE));
   board.setMovingSide(Side::WHITE);
+  board.setCastlingRights(WHITE_SHORT_CASTLING | WHITE_LONG_CASTLING);
   EvalRecord record = Engine::evaluateBoard(board);
   // castling valid both long and short
   assert(record.moves.size() == 10 + 9 + 5 + 2);
 
   // rook moved
-  Board rookMovedBoard = Board::makeMove(board, Move(Position(0,0),Position(1,0), MoveType::MOVE));
-  rookMovedBoard = Board::makeMove(rookMovedBoard, Move(Position(0,0),Position(0,0), MoveType::MOVE));
-  rookMovedBoard = Board::makeMove(rookMovedBoard, Move(Position(1,0),Position(0,0), MoveType::MOVE));
-  rookMovedBoard = Board::makeMove(rookMovedBoard, Move(Position(0,0),Position(0,0), MoveType::MOVE));
+  Board rookMovedBoard = Board::makeMove(board, Move(Position(0,0),Position(1,0)));
+  rookMovedBoard = Board::makeMove(rookMovedBoard, Move(Position(0,0),Position(0,0)));
+  rookMovedBoard = Board::makeMove(rookMovedBoard, Move(Position(1,0),Position(0,0)));
+  rookMovedBoard = Board::makeMove(rookMovedBoard, Move(Position(0,0),Position(0,0)));
   assert(board.getMovingSide() == Side::WHITE);
   record = Engine::evaluateBoard(rookMovedBoard);
   assert(record.moves.size() == 10 + 9 + 5 + 1);
@@ -112,14 +172,14 @@ void test_moveEnpassant(){
   board.setSquare(Position(3,6),Square(PieceType::PAWN_PIECE, SideBit::BLACK));
   board.setMovingSide(Side::WHITE);
 
-  Board boardEP = Board::makeMove(board, Move(Position(1,1),Position(3,1),MoveType::MOVE));
+  Board boardEP = Board::makeMove(board, Move(Position(1,1),Position(3,1),MoveFlag::DOUBLE_PAWN_PUSH));
   EvalRecord record = Engine::evaluateBoard(boardEP);
   assert(record.moves.size() == 3);
 
   // black move, ep clears on col 1
-  Board boardPastEP1 = Board::makeMove(boardEP,Move(Position(3,6),Position(2,6),MoveType::MOVE));
+  Board boardPastEP1 = Board::makeMove(boardEP,Move(Position(3,6),Position(2,6)));
   // white move, ep not reachable on col 0
-  Board boardPastEP2 = Board::makeMove(boardPastEP1,Move(Position(1,0),Position(3,0),MoveType::MOVE));
+  Board boardPastEP2 = Board::makeMove(boardPastEP1,Move(Position(1,0),Position(3,0),MoveFlag::DOUBLE_PAWN_PUSH));
   record = Engine::evaluateBoard(boardPastEP2);
   assert(record.moves.size() == 2);
   
@@ -147,8 +207,653 @@ void test_quietSearch(){
   board.setMovingSide(Side::BLACK);
   result = engine.evaluate(board, context, 1, MIN_SCORE, MAX_SCORE, 2, true);
   assert(context.nodesEvaluated > 5);
-  assert(result.score > 100);
+  // for black, to move
+  assert(result.score < -100);
+
+}
+
+void test_transpositionTable(){
+  TranspositionTable tt(1);
+  assert(tt.getSizeBytes() == 1024*1024);
+  TTEntry entry;
+  uint64_t key = 0x123456789abcdef0ULL;
+  assert(!tt.probe(key, entry));
+
+  Move move(Position(1,4),Position(3,4),MoveFlag::DOUBLE_PAWN_PUSH);
+  tt.store(key, move, 35, BoundType::EXACT, 4, 2, true);
+  assert(tt.probe(key, entry));
+  assert(entry.bestMove.data == move.data && entry.score == 35 && entry.depth == 4 && entry.qsDepth == 2);
+  assert(entry.getBound() == BoundType::EXACT && entry.isQuietPosition());
+
+  // same bucket, different verification key
+  assert(!tt.probe(key ^ (1ULL<<40), entry));
+
+  // overwrite without a move keeps the known best move
+  tt.store(key, Move(), -20, BoundType::UPPER, 5, 2, false);
+  assert(tt.probe(key, entry));
+  assert(entry.bestMove.data == move.data && entry.score == -20 && entry.getBound() == BoundType::UPPER);
+
+  // a shallower bound of the same search is dropped, an exact score or an older entry is replaced
+  tt.store(key, Move(), 10, BoundType::LOWER, 3, 2, false);
+  assert(tt.probe(key, entry) && entry.score == -20 && entry.depth == 5);
+  tt.store(key, Move(), 10, BoundType::EXACT, 3, 2, false);
+  assert(tt.probe(key, entry) && entry.score == 10 && entry.depth == 3 && entry.bestMove.data == move.data);
+  tt.store(key, Move(), 5, BoundType::EXACT, 2, 2, false);
+  assert(tt.probe(key, entry) && entry.score == 10);
+  tt.newSearch();
+  tt.store(key, Move(), 5, BoundType::UPPER, 2, 2, false);
+  assert(tt.probe(key, entry) && entry.score == 5 && entry.depth == 2);
+
+  // full bucket evicts the shallowest entry
+  for(uint64_t i=1;i<=TT_BUCKET_SIZE;i++) {
+    tt.store(key + (i<<32), move, 0, BoundType::EXACT, 10 + i, 0, true);
+  }
+  assert(!tt.probe(key, entry));
+  assert(tt.probe(key + (TT_BUCKET_SIZE<<32), entry));
+
+  // entries of older searches are replaced before deeper current ones
+  tt.newSearch();
+  tt.store(key, move, 0, BoundType::EXACT, 1, 0, true);
+  assert(tt.probe(key, entry));
+
+  // concurrent stores to the same buckets, a probe finds a whole entry of the key or nothing
+  tt.clear();
+  std::atomic<bool> storesDone{false};
+  auto writer = [&tt, &storesDone](uint64_t seed) {
+    for(uint64_t i=0;i<200000;i++) {
+      uint64_t value = (i * 7 + seed) % 64;
+      tt.store((value << 32) | (value % 4), Move(Position(value), Position(63 - value)), value * 3, BoundType::EXACT, value, 0, true);
+    }
+  };
+  std::thread first(writer, 0), second(writer, 5);
+  std::thread reader([&tt, &storesDone]() {
+    while(!storesDone) {
+      for(uint64_t value=0;value<64;value++) {
+        TTEntry found;
+        if(tt.probe((value << 32) | (value % 4), found)) {
+          assert(found.score == static_cast<int16_t>(value * 3) && found.depth == value && found.bestMove.getFrom().data == value);
+        }
+      }
+    }
+  });
+  first.join();
+  second.join();
+  storesDone = true;
+  reader.join();
+}
+
+void test_lazySmp(){
+  // helpers share the table with the main search, which still returns a legal move
+  Engine engine;
+  engine.setThreads(3);
+  assert(engine.getThreads() == 3);
+  Board board;
+  board.startingPosition();
+  board = Board::makeMove(board, "e2e4");
+  Move bestMove = engine.findBestMove(board, 4);
+  MoveList moves;
+  generateMoves(board, moves);
+  assert(std::find_if(moves.begin(), moves.end(), [bestMove](const Move& move) { return move.data == bestMove.data; }) != moves.end());
+  assert(engine.getLastSearchNodes() > 0);
+
+  // split points: the same with moves handed to the pool
+  engine.setParallelSearch(ParallelSearch::SPLIT_POINTS);
+  bestMove = engine.findBestMove(board, 4);
+  assert(std::find_if(moves.begin(), moves.end(), [bestMove](const Move& move) { return move.data == bestMove.data; }) != moves.end());
+  const std::vector<SearchThreadStats>& stats = engine.getLastSearchThreadStats();
+  // a waiting owner runs queued tasks too, its own ones without a steal
+  assert(stats.size() == 3 && stats[0].steals <= stats[0].tasks && stats[1].steals <= stats[1].tasks);
+  engine.setThreads(0);
+  assert(engine.getThreads() == 1);
+}
+
+void test_infiniteSearch(){
+  // go infinite keeps searching past the depth until stopped from another thread, ponderhit hands it back to the time limit
+  Engine engine;
+  Board board;
+  board.startingPosition();
+  MoveList moves;
+  generateMoves(board, moves);
+  for(bool ponderhit : {false, true}) {
+    Move bestMove;
+    engine.prepareSearch(true);
+    std::thread search([&]() { bestMove = engine.findBestMove(board, 2, 2, 50); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    if(ponderhit) {
+      engine.ponderhit();
+    } else {
+      engine.stopSearch();
+    }
+    search.join();
+    assert(std::find_if(moves.begin(), moves.end(), [bestMove](const Move& move) { return move.data == bestMove.data; }) != moves.end());
+  }
+
+  // stopped right away, before the first iteration is done, it still returns a legal move
+  Board kiwipete;
+  kiwipete.loadFen("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+  MoveList kiwipeteMoves;
+  generateMoves(kiwipete, kiwipeteMoves);
+  engine.clearHash();
+  Move bestMove;
+  engine.prepareSearch(true);
+  std::thread search([&]() { bestMove = engine.findBestMove(kiwipete, 6); });
+  engine.stopSearch();
+  search.join();
+  assert(std::find_if(kiwipeteMoves.begin(), kiwipeteMoves.end(), [bestMove](const Move& move) { return move.data == bestMove.data; }) != kiwipeteMoves.end());
+}
+
+void test_timeManager(){
+  SearchLimits limits = parseGoLimits("go wtime 60000 btime 1000 winc 1000 binc 0 movestogo 20 nodes 5000000000 depth x ponder");
+  assert(limits.time[0] == 60000 && limits.time[1] == 1000 && limits.increment[0] == 1000 && limits.movesToGo == 20);
+  assert(limits.nodes == 5000000000LL && limits.depth == 0 && limits.ponder && !limits.infinite);
+  assert(!parseGoLimits("go").hasLimit(Side::WHITE) && !parseGoLimits("go btime 100").hasLimit(Side::WHITE));
+
+  // clock share plus most of the increment, the hard limit a few times that but never the whole clock
+  TimeManager white(limits, Side::WHITE);
+  assert(white.getSoftLimitMs() == (60000 - MOVE_OVERHEAD_MS) / 20 + 750 && white.getHardLimitMs() == 4*white.getSoftLimitMs());
+  TimeManager black(limits, Side::BLACK);
+  assert(black.getSoftLimitMs() == (1000 - MOVE_OVERHEAD_MS) / 20);
+  limits.movesToGo = 1;
+  TimeManager lastMove(limits, Side::WHITE);
+  assert(lastMove.getHardLimitMs() == (60000 - MOVE_OVERHEAD_MS) * 80 / 100 && lastMove.getSoftLimitMs() == lastMove.getHardLimitMs());
+  assert(TimeManager(parseGoLimits("go depth 5"), Side::WHITE).getHardLimitMs() == 0);
+
+  // a changing best move stretches the soft limit, a stable one shortens it; movetime is used as given
+  Move e2e4(Position(12), Position(28));
+  Move d2d4(Position(11), Position(27));
+  int32_t stableScale = white.getStabilityScalePercent();
+  assert(stableScale < 100);
+  white.onIterationDone(e2e4);
+  white.onIterationDone(d2d4);
+  assert(white.getStabilityScalePercent() > 100 && white.shouldStartIteration(white.getSoftLimitMs() / 2));
+  for(int i=0;i<8;i++) {
+    white.onIterationDone(d2d4);
+  }
+  assert(white.getStabilityScalePercent() == stableScale && !white.shouldStartIteration(white.getSoftLimitMs() / 2));
+  TimeManager moveTime(parseGoLimits("go movetime 1000"), Side::BLACK);
+  assert(moveTime.getSoftLimitMs() == 1000 - MOVE_OVERHEAD_MS && moveTime.getHardLimitMs() == moveTime.getSoftLimitMs());
+  assert(moveTime.getStabilityScalePercent() == 100);
+
+  // the node limit ends a search without a depth
+  Engine engine;
+  Board board;
+  board.startingPosition();
+  SearchLimits nodeLimits = parseGoLimits("go nodes 20000");
+  assert(engine.findBestMove(board, nodeLimits).data != 0);
+  assert(engine.getLastSearchNodes() < 30000);
+}
+
+void test_workStealingPool(){
+  // tasks pushed by worker 0 are all stolen by the others, cancel takes back only what nobody started
+  std::atomic<size_t> done{0};
+  size_t cancelled = 0;
+  int tag = 0;
+  {
+    WorkStealingPool pool(3);
+    assert(pool.getWorkerCount() == 3);
+    for(size_t i=0;i<100;i++) {
+      pool.push(0, &tag, [&done](size_t worker) {
+        assert(worker != 0);
+        done++;
+      });
+    }
+    cancelled = pool.cancel(0, &tag);
+    while(done + cancelled < 100) {
+      std::this_thread::yield();
+    }
+    assert(pool.getTasksRun(0) == 0 && pool.getTasksRun(1) + pool.getTasksRun(2) == static_cast<int64_t>(done.load()));
+    assert(pool.getSteals(1) == pool.getTasksRun(1) && pool.getSteals(2) == pool.getTasksRun(2));
+    assert(pool.cancel(0, &tag) == 0);
+  }
+  assert(done + cancelled == 100);
+
+  // a filtered worker skips the other tags' tasks, even its own newer ones
+  WorkStealingPool single(1);
+  int otherTag = 0;
+  std::vector<int> order;
+  single.push(0, &tag, [&order](size_t) { order.push_back(1); });
+  single.push(0, &otherTag, [&order](size_t) { order.push_back(2); });
+  TaskFilter onlyTag = [&tag](const void* taskTag) { return taskTag == &tag; };
+  assert(single.runOne(0, onlyTag) && !single.runOne(0, onlyTag));
+  assert(single.runOne(0) && !single.runOne(0));
+  assert((order == std::vector<int>{1, 2}));
+}
+
+void test_zobristHash(){
+  Board board;
+  board.startingPosition();
+  assert(board.hash == board.computeHash());
+
+  // transposition: same position by different move orders
+  Board board1 = Board::makeMove(Board::makeMove(Board::makeMove(Board::makeMove(board, "g1f3"), "g8f6"), "b1c3"), "b8c6");
+  Board board2 = Board::makeMove(Board::makeMove(Board::makeMove(Board::makeMove(board, "b1c3"), "b8c6"), "g1f3"), "g8f6");
+  assert(board1.hash == board2.hash && board1 == board2);
+  assert(board1.hash != board.hash);
+
+  // pieces moved out and back are the same position, castling rights are lost by king moves
+  Board knightsBack = Board::makeMove(Board::makeMove(Board::makeMove(Board::makeMove(board, "g1f3"), "g8f6"), "f3g1"), "f6g8");
+  assert(knightsBack == board && knightsBack.getHalfmoveClock() == 4);
+  Board kingBack = Board::makeMove(Board::makeMove(Board::makeMove(Board::makeMove(board, "e2e4"), "e7e5"), "e1e2"), "e8e7");
+  kingBack = Board::makeMove(Board::makeMove(kingBack, "e2e1"), "e7e8");
+  assert(kingBack.getCastlingRights() == 0 && kingBack.hash == kingBack.computeHash());
+  assert(kingBack.hash != Board::makeMove(Board::makeMove(board, "e2e4"), "e7e5").hash);
+
+  // en passant col is set only if the double pushed pawn can be captured
+  Board noEnPassant = Board::makeMove(Board::makeMove(board, "e2e4"), "e7e5");
+  Board viaSinglePushes = Board::makeMove(Board::makeMove(Board::makeMove(Board::makeMove(board, "e2e3"), "e7e6"), "e3e4"), "e6e5");
+  assert(noEnPassant.getEnPassantCol() == NO_COL && noEnPassant == viaSinglePushes);
+  Board enPassant = Board::makeMove(Board::makeMove(Board::makeMove(noEnPassant, "f2f4"), "a7a6"), "f4f5");
+  enPassant = Board::makeMove(enPassant, "g7g5");
+  assert(enPassant.getEnPassantCol() == 6 && enPassant.hash == enPassant.computeHash());
+
+  // captures, en passant, castling, promotion
+  std::vector<std::string> moves = {"e2e4", "d7d5", "e4d5", "c7c5", "d5c6", "b8a6", "c6b7", "g8f6", "b7a8q", "e7e6", "f1e2", "f8e7", "g1f3", "e8g8", "e1g1"};
+  for(const auto& move : moves) {
+    board = Board::makeMove(board, move);
+    assert(board.hash == board.computeHash());
+  }
+  assert(board.getSquare(Position(0,6)).getPieceType() == PieceType::KING_PIECE);
+  assert(board.getSquare(Position(7,0)).getPieceType() == PieceType::QUEEN_PIECE);
+
+  // side to move is part of the hash
+  Board otherSide = board;
+  otherSide.setMovingSide(board.getMovingSide() == Side::WHITE ? Side::BLACK : Side::WHITE);
+  assert(otherSide.hash != board.hash && otherSide.hash == otherSide.computeHash());
+}
+
+void test_pstScore() {
+  // symmetric position scores zero in both halves
+  Board board;
+  board.startingPosition();
+  assert(board.pstScore.mg == 0 && board.pstScore.eg == 0 && board.pstScore == board.computePstScore());
+
+  // mirrored moves keep the score symmetric, the incremental score follows captures and castling
+  std::vector<std::string> moves = {"e2e4", "e7e5", "g1f3", "g8f6", "f1c4", "f8c5", "e1g1", "e8g8", "f3e5", "f6e4"};
+  for(size_t i=0;i<moves.size();i++) {
+    board = Board::makeMove(board, moves[i]);
+    assert(board.pstScore == board.computePstScore());
+    assert(i % 2 == 0 || (board.pstScore.mg == 0 && board.pstScore.eg == 0));
+  }
+
+  // material and piece-square terms of a single piece
+  board.loadFen("4k3/8/8/8/8/8/4P3/4K3 w - - 0 1");
+  assert(board.pstScore.mg == MG_PIECE_VALUE[static_cast<uint8_t>(PieceType::PAWN_PIECE)]);
+  board = Board::makeMove(board, "e2e4");
+  assert(board.pstScore.mg == MG_PIECE_VALUE[static_cast<uint8_t>(PieceType::PAWN_PIECE)] + 2*MG_PAWN_ROW_PROGRESS_BONUS + CENTER_BONUS);
+  assert(board.pstScore.eg == EG_PIECE_VALUE[static_cast<uint8_t>(PieceType::PAWN_PIECE)] + 2*EG_PAWN_ROW_PROGRESS_BONUS + CENTER_BONUS);
+
+  // king belongs to the back row in the midgame and to the centre in the endgame
+  uint8_t whiteKing = Square(PieceType::KING_PIECE, SideBit::WHITE).data;
+  assert(PST[whiteKing][Position(3,4).data].mg < PST[whiteKing][Position(0,6).data].mg);
+  assert(PST[whiteKing][Position(3,4).data].eg > PST[whiteKing][Position(0,6).data].eg);
+}
+
+void test_gamePhase() {
+  // full material is the midgame end of the blend, bare kings the endgame end
+  Board board;
+  board.startingPosition();
+  assert(board.phase == MAX_PHASE && board.phase == board.computePhase());
+  PstScore score{100, -40};
+  assert(taper(score, MAX_PHASE) == 100 && taper(score, 0) == -40 && taper(score, MAX_PHASE/2) == 30);
+  // extra queens from promotions do not go past the midgame
+  assert(taper(score, MAX_PHASE + 8) == 100);
+
+  // phase follows captures and promotions, pawns do not count
+  std::vector<std::string> moves = {"e2e4", "d7d5", "e4d5", "d8d5", "b1c3", "d5a2", "a1a2"};
+  for(const std::string& move : moves) {
+    board = Board::makeMove(board, move);
+    assert(board.phase == board.computePhase());
+  }
+  assert(board.phase == MAX_PHASE - PHASE_WEIGHT[static_cast<uint8_t>(PieceType::QUEEN_PIECE)]);
+  board.loadFen("4k3/1P6/8/8/8/8/8/4K3 w - - 0 1");
+  assert(board.phase == 0);
+  board = Board::makeMove(board, "b7b8q");
+  assert(board.phase == PHASE_WEIGHT[static_cast<uint8_t>(PieceType::QUEEN_PIECE)] && board.phase == board.computePhase());
+}
+
+void test_endgames() {
+  // material key follows captures and promotions
+  Board board;
+  board.startingPosition();
+  assert(board.materialKey == board.computeMaterialKey() && board.getMaterialCount(Side::BLACK, PieceType::PAWN_PIECE) == 8);
+  std::vector<std::string> moves = {"e2e4", "d7d5", "e4d5", "d8d5", "b1c3", "d5a2", "a1a2"};
+  for(const std::string& move : moves) {
+    board = Board::makeMove(board, move);
+    assert(board.materialKey == board.computeMaterialKey());
+  }
+  assert(board.getMaterialCount(Side::BLACK, PieceType::QUEEN_PIECE) == 0 && board.getMaterialCount(Side::WHITE, PieceType::PAWN_PIECE) == 6);
+  board.loadFen("4k3/1P6/8/8/8/8/8/4K3 w - - 0 1");
+  board = Board::makeMove(board, "b7b8q");
+  assert(board.materialKey == board.computeMaterialKey() && board.getMaterialCount(Side::WHITE, PieceType::QUEEN_PIECE) == 1);
+
+  // no mating material
+  for(const char* fen : {"4k3/8/8/8/8/8/8/4K3 w - - 0 1", "4k3/8/8/8/8/8/8/3NK3 w - - 0 1", "3bk3/8/8/8/8/8/8/3BK3 w - - 0 1", "4k3/8/8/8/8/8/8/2NNK3 b - - 0 1"}) {
+    board.loadFen(fen);
+    int16_t score = 1;
+    assert(isKnownDraw(board) && evaluateEndgame(board, score) && score == 0 && evaluate(board) == 0);
+  }
+  for(const char* fen : {"4k3/8/8/8/8/8/8/3RK3 w - - 0 1", "4k3/8/8/8/8/8/4P3/4K3 w - - 0 1", "4k3/8/8/8/8/8/8/2BNK3 w - - 0 1"}) {
+    board.loadFen(fen);
+    assert(!isKnownDraw(board));
+  }
+
+  // rook against king: better with the defending king in the corner, mirrored for black
+  board.loadFen("8/8/8/3k4/8/8/8/R3K3 w - - 0 1");
+  int16_t centerScore = evaluate(board);
+  board.loadFen("7k/8/8/8/8/8/8/R3K3 w - - 0 1");
+  int16_t cornerScore = evaluate(board);
+  assert(centerScore >= KNOWN_WIN_SCORE && cornerScore > centerScore && cornerScore < AFTER_CHECKMATE_SCORE/2);
+  board.loadFen("r3k3/8/8/8/8/8/8/7K b - - 0 1");
+  assert(evaluate(board) == -cornerScore);
+
+  // bishop and knight: the corner of the bishop's colour
+  board.loadFen("k7/8/8/8/8/8/8/2B1KN2 w - - 0 1");
+  int16_t wrongCornerScore = evaluate(board);
+  board.loadFen("7k/8/8/8/8/8/8/2B1KN2 w - - 0 1");
+  assert(evaluate(board) > wrongCornerScore && wrongCornerScore >= KNOWN_WIN_SCORE);
+
+  // king and pawn: the pawn runs away, the defending king blocks it, the rook pawn corner
+  board.loadFen("8/k7/8/8/8/8/6P1/6K1 w - - 0 1");
+  assert(evaluate(board) >= KNOWN_WIN_SCORE);
+  board.loadFen("4k3/8/8/8/8/8/4P3/4K3 b - - 0 1");
+  assert(evaluate(board) == 0);
+  board.loadFen("8/8/8/8/8/1k6/6p1/K7 w - - 0 1");
+  assert(evaluate(board) <= -KNOWN_WIN_SCORE);
+  board.loadFen("k7/8/8/8/8/8/P7/4K3 w - - 0 1");
+  assert(evaluate(board) == 0);
+  // key square ahead of the pawn
+  board.loadFen("8/8/3k4/8/4K3/8/4P3/8 w - - 0 1");
+  assert(evaluate(board) >= KNOWN_WIN_SCORE);
+
+  // opposite coloured bishops a pawn up and a minor piece without pawns are scaled down
+  board.loadFen("4k3/5b2/8/8/8/8/3PP3/2B1K3 w - - 0 1");
+  assert(getEndgameScale(board, Side::WHITE) < ENDGAME_SCALE_NORMAL);
+  board.loadFen("4k3/4b3/8/8/8/8/3PP3/2B1K3 w - - 0 1");
+  assert(getEndgameScale(board, Side::WHITE) == ENDGAME_SCALE_NORMAL);
+  board.loadFen("4k3/8/8/8/8/8/8/2R1KB2 w - - 0 1");
+  assert(getEndgameScale(board, Side::WHITE) == ENDGAME_SCALE_NORMAL);
+  board.loadFen("4k3/4r3/8/8/8/8/8/2R1KB2 w - - 0 1");
+  assert(getEndgameScale(board, Side::WHITE) < ENDGAME_SCALE_NORMAL);
+}
+
+void test_kpkBitbase() {
+  // generation split over threads gives the same bits
+  KpkBitbase bitbase;
+  bitbase.generate(1);
+  KpkBitbase threaded;
+  threaded.generate(3);
+  assert(bitbase == threaded && bitbase.getSizeBytes() == KPK_INDEX_COUNT / 8);
+
+  // pawn runs away, king in front on the 6th row, rook pawn with the corner, stalemate or Kd6-d7, opposition
+  std::vector<std::pair<std::string, bool>> positions = {
+    {"8/k7/8/8/8/8/6P1/6K1 w - - 0 1", true},
+    {"4k3/8/4K3/4P3/8/8/8/8 w - - 0 1", true},
+    {"4k3/8/4K3/4P3/8/8/8/8 b - - 0 1", true},
+    {"k7/8/8/8/8/8/P7/K7 w - - 0 1", false},
+    {"4k3/4P3/4K3/8/8/8/8/8 b - - 0 1", false},
+    {"4k3/4P3/4K3/8/8/8/8/8 w - - 0 1", true},
+    {"8/8/4k3/8/4K3/4P3/8/8 w - - 0 1", false},
+    {"8/8/4k3/8/4K3/4P3/8/8 b - - 0 1", true},
+  };
+  Board board;
+  for(const auto& position : positions) {
+    board.loadFen(position.first);
+    assert(threaded.probe(board, Side::WHITE) == position.second);
+    // same position with colours swapped and mirrored files
+    Side movingSide = Board::getOpponentSide(board.getMovingSide());
+    uint8_t flip = 0b111000 | 0b111;
+    assert(threaded.probe(Side::BLACK, lsb(board.getPieces(Side::WHITE, PieceType::KING_PIECE)) ^ flip, lsb(board.getPieces(Side::WHITE, PieceType::PAWN_PIECE)) ^ flip,
+      lsb(board.getPieces(Side::BLACK, PieceType::KING_PIECE)) ^ flip, movingSide) == position.second);
+  }
+}
+
+void test_attackCountKernels() {
+  // every supported SIMD level matches the scalar loop bit for bit
+  std::vector<std::pair<std::array<int8_t,64>, std::array<int8_t,64>>> inputs;
+  inputs.push_back({{}, {}});
+  std::array<int8_t,64> maxCounts;
+  maxCounts.fill(127);
+  inputs.push_back({maxCounts, {}});
+  uint64_t state = 0x2545f4914f6cdd1dULL;
+  for(size_t i=0;i<1000;i++) {
+    std::array<int8_t,64> white, black;
+    for(uint8_t pos=0;pos<64;pos++) {
+      state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+      // mostly small counts with some zeros, as on a board
+      white[pos] = (state >> 33) % 5 == 0 ? 0 : (state >> 40) % 12;
+      black[pos] = (state >> 45) % 5 == 0 ? 0 : (state >> 52) % 12;
+    }
+    inputs.push_back({white, black});
+  }
+  for(const PerftPosition& position : PERFT_SUITE) {
+    Board board;
+    board.loadFen(position.fen);
+    inputs.push_back({board.attackCount[0], board.attackCount[1]});
+  }
+
+  for(const auto& input : inputs) {
+    AttackCountSummary expected = summarizeAttackCounts(input.first, input.second, SimdLevel::SCALAR);
+    for(uint8_t level=0;level<=static_cast<uint8_t>(getSimdLevel());level++) {
+      assert(summarizeAttackCounts(input.first, input.second, static_cast<SimdLevel>(level)) == expected);
+    }
+    assert(summarizeAttackCounts(input.first, input.second) == expected);
+  }
+
+  AttackCountSummary summary = summarizeAttackCounts(maxCounts, inputs[0].second, SimdLevel::SCALAR);
+  assert(summary.whiteAttacked == ~0ULL && summary.whiteMore == ~0ULL && summary.blackAttacked == 0 && summary.blackMore == 0);
+  assert(summary.whiteTotal == 64*127 && summary.blackTotal == 0);
+}
+
+void test_pawnStructure() {
+  // white: doubled and isolated c pawns, black: passed a pawn
+  Board board;
+  board.loadFen("4k3/p7/8/8/8/2P5/2P5/4K3 w - - 0 1");
+  PawnEntry entry;
+  evaluatePawnStructure(board, entry);
+  assert(entry.passed[0] == squareBB(Position(2,2).data) && entry.passed[1] == squareBB(Position(6,0).data));
+  assert(entry.structure.mg < 0 && entry.structure.eg < 0);
+
+  // same structure, mirrored sides
+  Board mirrored;
+  mirrored.loadFen("4k3/2p5/2p5/8/8/8/P7/4K3 w - - 0 1");
+  PawnEntry mirroredEntry;
+  evaluatePawnStructure(mirrored, mirroredEntry);
+  assert(mirroredEntry.structure.mg == -entry.structure.mg && mirroredEntry.structure.eg == -entry.structure.eg);
+
+  // pawn key ignores everything but pawns, the table hits on the same structure
+  Board kingMoved = Board::makeMove(board, "e1d1");
+  assert(kingMoved.pawnKey == board.pawnKey && kingMoved.hash != board.hash);
+  PawnTable table(16);
+  table.probe(board);
+  assert(table.getStats().probes == 1 && table.getStats().hits == 0);
+  const PawnEntry& hit = table.probe(kingMoved);
+  assert(table.getStats().hits == 1 && table.getStats().shieldUpdates == 1 && hit.structure == entry.structure);
+  table.probe(Board::makeMove(board, "c3c4"));
+  assert(table.getStats().hits == 1);
+
+  // pawns in front of the castled king
+  board.startingPosition();
+  Board castled = Board::makeMove(board, "e2e4");
+  assert(evaluateKingShield(castled, Side::WHITE).mg < evaluateKingShield(board, Side::WHITE).mg);
+}
+
+void test_nnue() {
+  NnueNetwork network = NnueNetwork::random(7);
+
+  // file layout round trip, wrong header is rejected
+  std::stringstream stream;
+  network.save(stream);
+  NnueNetwork loaded = NnueNetwork::random(8);
+  assert(loaded.load(stream));
+  assert(loaded.featureWeights == network.featureWeights && loaded.featureBias == network.featureBias);
+  assert(loaded.outputWeights == network.outputWeights && loaded.outputBias == network.outputBias);
+  std::stringstream truncated(stream.str().substr(0, 100));
+  assert(!loaded.load(truncated) && loaded.featureWeights == network.featureWeights);
+
+  // accumulator follows moves and undos, every kernel gives the same output
+  Board board;
+  board.loadFen("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+  board.setNetwork(&network);
+  uint64_t state = 0x9e3779b97f4a7c15ULL;
+  for(size_t ply=0;ply<60;ply++) {
+    MoveList moves;
+    generateMoves(board, moves);
+    if(moves.size() == 0) {
+      break;
+    }
+    for(const Move& move : moves) {
+      UndoRecord undo;
+      board.doMove(move, undo);
+      assert(board.accumulator == board.computeAccumulator());
+      board.undoMove(move, undo);
+    }
+    assert(board.accumulator == board.computeAccumulator());
+
+    const auto& moving = board.accumulator[static_cast<uint8_t>(board.getMovingSide())];
+    const auto& waiting = board.accumulator[static_cast<uint8_t>(Board::getOpponentSide(board.getMovingSide()))];
+    int32_t expected = propagateNnue(network, moving, waiting, SimdLevel::SCALAR);
+    for(uint8_t level=0;level<=static_cast<uint8_t>(getSimdLevel());level++) {
+      assert(propagateNnue(network, moving, waiting, static_cast<SimdLevel>(level)) == expected);
+    }
+    int16_t score = evaluate(board)*Board::getSideSign(board.getMovingSide());
+    assert(score == std::clamp<int32_t>(expected, -AFTER_CHECKMATE_SCORE/2 + 1, AFTER_CHECKMATE_SCORE/2 - 1));
+
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    UndoRecord undo;
+    board.doMove(moves[state % moves.size()], undo);
+  }
+
+  // the engine searches with the network once it is switched on
+  Engine engine;
+  engine.setNetwork(network);
+  assert(!engine.isUsingNnue());
+  engine.setUseNnue(true);
+  assert(engine.isUsingNnue());
+  Board startBoard;
+  startBoard.startingPosition();
+  Move bestMove = engine.findBestMove(startBoard, 3);
+  MoveList moves;
+  generateMoves(startBoard, moves);
+  assert(std::find_if(moves.begin(), moves.end(), [bestMove](const Move& move) { return move.data == bestMove.data; }) != moves.end());
+  assert(!engine.loadNetwork("/nonexistent/network.nnue") && engine.isUsingNnue());
+}
+
+void test_bitboardAttacks(){
+  assert(KNIGHT_ATTACKS[Position(0,0).data] == (squareBB(Position(1,2).data) | squareBB(Position(2,1).data)));
+  assert(popcount(KNIGHT_ATTACKS[Position(3,3).data]) == 8);
+  assert(popcount(KING_ATTACKS[Position(0,7).data]) == 3);
+  assert(popcount(KING_ATTACKS[Position(4,4).data]) == 8);
+  assert(PAWN_ATTACKS[0][Position(1,0).data] == squareBB(Position(2,1).data));
+  assert(PAWN_ATTACKS[1][Position(6,4).data] == (squareBB(Position(5,3).data) | squareBB(Position(5,5).data)));
+
+  // rays stop on and include the first blocker
+  Bitboard occupancy = squareBB(Position(3,6).data) | squareBB(Position(1,3).data);
+  Bitboard rook = rookAttacks(Position(3,3).data, occupancy);
+  assert(popcount(rook) == 3 + 4 + 3 + 2);
+  assert(rook & squareBB(Position(3,6).data));
+  assert(!(rook & squareBB(Position(3,7).data)));
+  assert(popcount(bishopAttacks(Position(0,0).data, 0)) == 7);
+  assert(popcount(queenAttacks(Position(3,3).data, 0)) == 27);
+
+  // lookup tables agree with ray walking
+  uint64_t state = 0x9e3779b97f4a7c15ULL;
+  for(size_t i=0;i<1000;i++) {
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    Bitboard randomOccupancy = state & (state << 17) & (state >> 9);
+    for(uint8_t pos=0;pos<64;pos++) {
+      assert(rookAttacks(pos, randomOccupancy) == rookRayAttacks(pos, randomOccupancy));
+      assert(bishopAttacks(pos, randomOccupancy) == bishopRayAttacks(pos, randomOccupancy));
+    }
+  }
+
+  // board bitboards follow the squares
+  Board board;
+  board.startingPosition();
+  assert(board.getOccupancy() == (rowBB(0) | rowBB(1) | rowBB(6) | rowBB(7)));
+  assert(board.getPieces(Side::BLACK, PieceType::KNIGHT_PIECE) == (squareBB(Position(7,1).data) | squareBB(Position(7,6).data)));
+  board = Board::makeMove(Board::makeMove(Board::makeMove(board, "e2e4"), "d7d5"), "e4d5");
+  assert(board.getPieces(Side::WHITE, PieceType::PAWN_PIECE) == ((rowBB(1) & ~squareBB(Position(1,4).data)) | squareBB(Position(4,3).data)));
+  assert(popcount(board.getOccupancy(Side::BLACK)) == 15);
+}
+
+void test_doUndoMove(){
+  Board board;
+  board.startingPosition();
+  // captures, en passant, castling, promotion
+  std::vector<std::string> moves = {"e2e4", "d7d5", "e4d5", "c7c5", "d5c6", "b8a6", "c6b7", "g8f6", "b7a8q", "e7e6", "f1e2", "f8e7", "g1f3", "e8g8", "e1g1", "a6b4", "b1a3", "b4a2"};
+  for(const auto& moveString : moves) {
+    Board expected = Board::makeMove(board, moveString);
+    // every move from this position is taken back exactly
+    EvalRecord record = Engine::evaluateBoard(board);
+    for(const Move& move : record.moves) {
+      Board before = board;
+      UndoRecord undo;
+      board.doMove(move, undo);
+      assert(board.hash == board.computeHash() && board.pstScore == board.computePstScore() && board.attackCount == board.computeAttackCount());
+      assert(board.pawnKey == board.computePawnKey() && board.phase == board.computePhase());
+      board.undoMove(move, undo);
+      assert(board == before && board.pieces == before.pieces && board.gamestate == before.gamestate && board.pstScore == before.pstScore);
+      assert(board.attackCount == before.attackCount);
+      // perft's moves leave the attack counts alone
+      board.doMove<false>(move, undo);
+      assert(board.hash == board.computeHash() && board.attackCount == before.attackCount);
+      board.undoMove<false>(move, undo);
+      assert(board == before && board.attackCount == before.attackCount);
+    }
+    // parsed UCI move carries the same flags as the generated one
+    Move move = board.parseMove(moveString);
+    assert(std::any_of(record.moves.begin(), record.moves.end(), [&move](const Move& generated) { return generated.data == move.data; }));
+    UndoRecord undo;
+    board.doMove(move, undo);
+    assert(board == expected && board.pieces == expected.pieces);
+  }
+}
 
+void test_moveEncoding(){
+  assert(sizeof(Move) == 2);
+  Move promotion(Position(6,1), Position(7,0), getPromotionFlag(PieceType::KNIGHT_PIECE, true));
+  assert(promotion.getFrom().data == Position(6,1).data && promotion.getTo().data == Position(7,0).data);
+  assert(promotion.isCapture() && promotion.isPromotion() && promotion.getPromotionType() == PieceType::KNIGHT_PIECE);
+  assert(promotion.print() == "b7a8n");
+
+  Board board;
+  board.startingPosition();
+  board = Board::makeMove(Board::makeMove(Board::makeMove(board, "e2e4"), "a7a6"), "e4e5");
+  board = Board::makeMove(board, "d7d5");
+  Move enPassant = board.parseMove("e5d6");
+  assert(enPassant.getFlag() == MoveFlag::EN_PASSANT && enPassant.isCapture() && !enPassant.isPromotion());
+  assert(enPassant.print() == "e5d6");
+  assert(board.parseMove("e1e2").getFlag() == MoveFlag::QUIET);
+  assert(board.parseMove("f7f5").getFlag() == MoveFlag::DOUBLE_PAWN_PUSH);
+}
+
+void test_perft(){
+  Board startBoard;
+  startBoard.startingPosition();
+  Board fenBoard;
+  assert(fenBoard.loadFen(PERFT_SUITE[0].fen));
+  assert(fenBoard == startBoard);
+
+  // move generator against known leaf counts
+  for(const PerftPosition& position : PERFT_SUITE) {
+    Board board;
+    board.loadFen(position.fen);
+    for(uint8_t depth=1;depth<=3;depth++) {
+      assert(perft(board, depth) == position.counts[depth-1]);
+    }
+  }
+
+  // hashed and threaded counts agree
+  PerftOptions options;
+  options.depth = 4;
+  options.threads = 2;
+  options.hashSizeMb = 1;
+  Board board;
+  board.loadFen(PERFT_SUITE[1].fen);
+  PerftResult result = runPerft(board, options);
+  assert(result.nodes == PERFT_SUITE[1].counts[3] && result.rootMoves.size() == PERFT_SUITE[1].counts[0]);
 }
 
 void test_all() {
@@ -156,10 +861,29 @@ void test_all() {
   test_boardEvalPawnBishop();
   test_boardEvalStalemate();
   test_boardEvalAfterCheckmate();
+  test_legalMoves();
+  test_evaluateWithoutMoves();
   test_boardEvalPawnKnightQueen();
   test_moveCastling();
   test_moveEnpassant();
   test_quietSearch();
+  test_transpositionTable();
+  test_lazySmp();
+  test_infiniteSearch();
+  test_timeManager();
+  test_workStealingPool();
+  test_zobristHash();
+  test_pstScore();
+  test_gamePhase();
+  test_endgames();
+  test_kpkBitbase();
+  test_bitboardAttacks();
+  test_attackCountKernels();
+  test_pawnStructure();
+  test_nnue();
+  test_doUndoMove();
+  test_moveEncoding();
+  test_perft();
   std::cout << "Tests passed";
 }
 
@@ -0,0 +1,83 @@
+#include "timeman.h"
+
+#include <sstream>
+
+namespace chesseng {
+namespace {
+// the hard limit is this many soft limits, at most this share of the clock
+constexpr int32_t HARD_LIMIT_SCALE = 4;
+constexpr int32_t MAX_CLOCK_PERCENT = 80;
+// share of the increment spent on top of the clock share
+constexpr int32_t INCREMENT_PERCENT = 75;
+// an iteration takes about as long as all before it, one started later would be cut by the hard limit
+constexpr int32_t NEXT_ITERATION_PERCENT = 50;
+}
+
+SearchLimits parseGoLimits(const std::string& input) {
+  SearchLimits limits;
+  std::istringstream sstream(input);
+  std::string word;
+  int64_t value = 0;
+  while(sstream >> word) {
+    if(word == "infinite") {
+      limits.infinite = true;
+    } else if(word == "ponder") {
+      limits.ponder = true;
+    } else if(word == "wtime" && sstream >> value) {
+      limits.time[static_cast<uint8_t>(Side::WHITE)] = value;
+    } else if(word == "btime" && sstream >> value) {
+      limits.time[static_cast<uint8_t>(Side::BLACK)] = value;
+    } else if(word == "winc" && sstream >> value) {
+      limits.increment[static_cast<uint8_t>(Side::WHITE)] = value;
+    } else if(word == "binc" && sstream >> value) {
+      limits.increment[static_cast<uint8_t>(Side::BLACK)] = value;
+    } else if(word == "movestogo" && sstream >> value) {
+      limits.movesToGo = value;
+    } else if(word == "movetime" && sstream >> value) {
+      limits.moveTime = value;
+    } else if(word == "nodes" && sstream >> value) {
+      limits.nodes = value;
+    } else if(word == "depth" && sstream >> value) {
+      limits.depth = value;
+    }
+    // a value that is not a number leaves the stream failed
+    sstream.clear();
+  }
+  return limits;
+}
+
+TimeManager::TimeManager(const SearchLimits& limits, Side side) {
+  if(limits.moveTime > 0) {
+    fixedTime = true;
+    softLimitMs = std::max(1, limits.moveTime - MOVE_OVERHEAD_MS);
+    hardLimitMs = softLimitMs;
+    return;
+  }
+  int32_t time = limits.time[static_cast<uint8_t>(side)];
+  if(time <= 0) {
+    return;
+  }
+  int32_t available = std::max(1, time - MOVE_OVERHEAD_MS);
+  int32_t movesToGo = limits.movesToGo > 0 ? limits.movesToGo : DEFAULT_MOVES_TO_GO;
+  int64_t soft = available / movesToGo + (int64_t)limits.increment[static_cast<uint8_t>(side)] * INCREMENT_PERCENT / 100;
+  int64_t hard = std::min<int64_t>(soft * HARD_LIMIT_SCALE, (int64_t)available * MAX_CLOCK_PERCENT / 100);
+  hardLimitMs = std::max<int64_t>(1, hard);
+  softLimitMs = std::max<int64_t>(1, std::min(soft, hard));
+}
+
+void TimeManager::onIterationDone(const Move& bestMove) {
+  instability /= 2;
+  if(lastBestMove.data != 0 && bestMove.data != lastBestMove.data) {
+    instability += CHANGE_INSTABILITY;
+  }
+  lastBestMove = bestMove;
+}
+
+bool TimeManager::shouldStartIteration(int32_t elapsedMs) const {
+  if(softLimitMs == 0) {
+    return true;
+  }
+  return elapsedMs < (int64_t)softLimitMs * getStabilityScalePercent() / 100 * NEXT_ITERATION_PERCENT / 100;
+}
+
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include "board.h"
+
+namespace chesseng {
+
+// UCI go without any limit searches this long
+constexpr int32_t DEFAULT_MOVE_TIME_MS = 5000;
+// kept back from the clock for the GUI and the transfer of the move
+constexpr int32_t MOVE_OVERHEAD_MS = 30;
+// moves the remaining time is split over when the GUI does not send movestogo
+constexpr int32_t DEFAULT_MOVES_TO_GO = 30;
+
+// the limits of a UCI go command, 0 is no limit
+struct SearchLimits {
+  int16_t depth{0};
+  // remaining clock time and increment per move, by side
+  std::array<int32_t, 2> time{0, 0};
+  std::array<int32_t, 2> increment{0, 0};
+  int32_t movesToGo{0};
+  int32_t moveTime{0};
+  // main thread nodes
+  int64_t nodes{0};
+  bool infinite{false};
+  bool ponder{false};
+
+  inline bool isTimed(Side side) const {
+    return moveTime > 0 || time[static_cast<uint8_t>(side)] > 0;
+  }
+  inline bool hasLimit(Side side) const {
+    return depth > 0 || nodes > 0 || infinite || isTimed(side);
+  }
+};
+
+// wtime btime winc binc movestogo movetime nodes depth infinite ponder, unknown words are skipped
+SearchLimits parseGoLimits(const std::string& input);
+
+// soft limit: no new iteration after it, scaled by how often the best move changed;
+// hard limit: the running iteration is stopped
+class TimeManager {
+  public:
+  TimeManager(const SearchLimits& limits, Side side);
+
+  inline int32_t getSoftLimitMs() const {
+    return softLimitMs;
+  }
+  inline int32_t getHardLimitMs() const {
+    return hardLimitMs;
+  }
+  // after every finished iteration of the main thread
+  void onIterationDone(const Move& bestMove);
+  // the soft limit stretched for an unstable best move and shortened for a stable one, in percent
+  inline int32_t getStabilityScalePercent() const {
+    return fixedTime ? 100 : std::min(STABLE_SCALE_PERCENT + instability, MAX_SCALE_PERCENT);
+  }
+  bool shouldStartIteration(int32_t elapsedMs) const;
+
+  private:
+  // a best move that did not change for a few iterations gets this share of the soft limit
+  static constexpr int32_t STABLE_SCALE_PERCENT = 70;
+  static constexpr int32_t MAX_SCALE_PERCENT = 250;
+  // added to the instability on every change of the best move, which halves each iteration
+  static constexpr int32_t CHANGE_INSTABILITY = 100;
+
+  int32_t softLimitMs{0};
+  int32_t hardLimitMs{0};
+  // movetime is spent as given
+  bool fixedTime{false};
+  int32_t instability{0};
+  Move lastBestMove;
+};
+
+}
@@ -0,0 +1,157 @@
+#include "tt.h"
+
+#include <algorithm>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace chesseng {
+namespace {
+constexpr int32_t TT_AGE_WEIGHT = 8;
+constexpr size_t HASHFULL_SAMPLE_BUCKETS = 250;
+
+inline uint8_t getRelativeAge(uint8_t generation, const TTEntry& entry) {
+  return (generation + TT_GENERATION_COUNT - entry.getGeneration()) % TT_GENERATION_COUNT;
+}
+
+// relaxed atomic word access, plain loads and stores on x86
+#if defined(_MSC_VER)
+inline uint32_t loadWord(const uint32_t& word) {
+  return static_cast<uint32_t>(__iso_volatile_load32(reinterpret_cast<const volatile __int32*>(&word)));
+}
+
+inline void storeWord(uint32_t& word, uint32_t value) {
+  __iso_volatile_store32(reinterpret_cast<volatile __int32*>(&word), static_cast<__int32>(value));
+}
+#else
+inline uint32_t loadWord(const uint32_t& word) {
+  return __atomic_load_n(&word, __ATOMIC_RELAXED);
+}
+
+inline void storeWord(uint32_t& word, uint32_t value) {
+  __atomic_store_n(&word, value, __ATOMIC_RELAXED);
+}
+#endif
+
+inline TTEntry loadEntry(const TTSlot& slot) {
+  uint32_t moveScore = loadWord(slot.moveScore);
+  uint32_t depthFlags = loadWord(slot.depthFlags);
+  TTEntry entry;
+  entry.key32 = loadWord(slot.check) ^ moveScore ^ depthFlags;
+  entry.bestMove.data = moveScore & 0xffff;
+  entry.score = static_cast<int16_t>(moveScore >> 16);
+  entry.depth = depthFlags & 0xff;
+  entry.qsDepth = (depthFlags >> 8) & 0xff;
+  entry.flags = (depthFlags >> 16) & 0xff;
+  return entry;
+}
+
+inline void storeEntry(TTSlot& slot, const TTEntry& entry) {
+  uint32_t moveScore = entry.bestMove.data | (static_cast<uint32_t>(static_cast<uint16_t>(entry.score)) << 16);
+  uint32_t depthFlags = entry.depth | (entry.qsDepth << 8) | (entry.flags << 16);
+  storeWord(slot.check, entry.key32 ^ moveScore ^ depthFlags);
+  storeWord(slot.moveScore, moveScore);
+  storeWord(slot.depthFlags, depthFlags);
+}
+}
+
+TranspositionTable::TranspositionTable(size_t sizeMb) {
+  resize(sizeMb);
+}
+
+void TranspositionTable::resize(size_t sizeMb) {
+  size_t bucketCount = 1;
+  size_t maxBuckets = std::max<size_t>(sizeMb, 1) * 1024 * 1024 / sizeof(TTBucket);
+  while(bucketCount * 2 <= maxBuckets) {
+    bucketCount *= 2;
+  }
+  buckets = std::vector<TTBucket>();
+  buckets.resize(bucketCount);
+  bucketMask = bucketCount - 1;
+  generation = 0;
+}
+
+void TranspositionTable::clear() {
+  std::fill(buckets.begin(), buckets.end(), TTBucket());
+  generation = 0;
+}
+
+void TranspositionTable::newSearch() {
+  generation = (generation + 1) % TT_GENERATION_COUNT;
+}
+
+bool TranspositionTable::probe(uint64_t key, TTEntry& entry) const {
+  uint32_t key32 = key >> 32;
+  for(const TTSlot& slot : getBucket(key).slots) {
+    TTEntry candidate = loadEntry(slot);
+    if(candidate.key32 == key32 && candidate.getBound() != BoundType::NONE) {
+      entry = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+void TranspositionTable::store(uint64_t key, Move bestMove, int16_t score, BoundType bound, uint8_t depth, uint8_t qsDepth, bool isQuietPosition) {
+  uint32_t key32 = key >> 32;
+  TTBucket& bucket = getBucket(key);
+
+  // same position or empty slot first, else evict the shallowest / oldest entry;
+  // another thread may write the bucket meanwhile, then one of the two stores is lost
+  TTSlot* replace = &bucket.slots[0];
+  TTEntry replaced = loadEntry(*replace);
+  int32_t replaceWorth = INT32_MAX;
+  for(TTSlot& slot : bucket.slots) {
+    TTEntry candidate = loadEntry(slot);
+    if(candidate.key32 == key32 || candidate.getBound() == BoundType::NONE) {
+      replace = &slot;
+      replaced = candidate;
+      break;
+    }
+    int32_t worth = candidate.depth - TT_AGE_WEIGHT * getRelativeAge(generation, candidate);
+    if(worth < replaceWorth) {
+      replaceWorth = worth;
+      replace = &slot;
+      replaced = candidate;
+    }
+  }
+
+  if(replaced.key32 == key32 && replaced.getBound() != BoundType::NONE) {
+    // a shallower result of this search does not replace a deeper one unless it turns a bound into an exact score
+    bool shallower = depth <= replaced.depth && qsDepth <= replaced.qsDepth && (depth < replaced.depth || qsDepth < replaced.qsDepth);
+    bool betterBound = bound == BoundType::EXACT && replaced.getBound() != BoundType::EXACT;
+    if(shallower && !betterBound && replaced.getGeneration() == generation) {
+      return;
+    }
+    // keep the known best move if this search did not produce one
+    if(bestMove.data == 0) {
+      bestMove = replaced.bestMove;
+    }
+  }
+
+  TTEntry entry;
+  entry.key32 = key32;
+  entry.bestMove = bestMove;
+  entry.score = score;
+  entry.depth = depth;
+  entry.qsDepth = qsDepth;
+  entry.flags = static_cast<uint8_t>(bound) | (isQuietPosition ? TT_QUIET_BIT : 0) | (generation << TT_GENERATION_SHIFT);
+  storeEntry(*replace, entry);
+}
+
+int32_t TranspositionTable::hashfull() const {
+  size_t sampleBuckets = std::min(HASHFULL_SAMPLE_BUCKETS, buckets.size());
+  int32_t used = 0;
+  for(size_t i=0;i<sampleBuckets;i++) {
+    for(const TTSlot& slot : buckets[i].slots) {
+      TTEntry entry = loadEntry(slot);
+      if(entry.getBound() != BoundType::NONE && entry.getGeneration() == generation) {
+        used++;
+      }
+    }
+  }
+  return used * 1000 / (sampleBuckets * TT_BUCKET_SIZE);
+}
+
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "board.h"
+
+namespace chesseng {
+
+constexpr size_t DEFAULT_TT_SIZE_MB = 64;
+
+enum class BoundType: uint8_t {
+  NONE=0,
+  // score is exact
+  EXACT=1,
+  // score is a lower bound (search failed high)
+  LOWER=2,
+  // score is an upper bound (search failed low)
+  UPPER=3
+};
+
+// entry flags struct:
+// 0-1 bit: bound type
+// 2 bit: position is quiet
+// 3-7 bit: generation
+constexpr uint8_t TT_BOUND_MASK = 0b11;
+constexpr uint8_t TT_QUIET_BIT = (1<<2);
+constexpr uint8_t TT_GENERATION_SHIFT = 3;
+constexpr uint8_t TT_GENERATION_COUNT = 32;
+
+struct TTEntry {
+  inline BoundType getBound() const {
+    return static_cast<BoundType>(flags & TT_BOUND_MASK);
+  }
+  inline bool isQuietPosition() const {
+    return (flags & TT_QUIET_BIT) != 0;
+  }
+  inline uint8_t getGeneration() const {
+    return flags >> TT_GENERATION_SHIFT;
+  }
+
+  // upper 32 bits of position hash, lower bits select the bucket
+  uint32_t key32{0};
+  Move bestMove;
+  int16_t score{0};
+  uint8_t depth{0};
+  uint8_t qsDepth{0};
+  uint8_t flags{0};
+};
+
+// an entry as stored, three 32 bit words written and read one at a time by concurrent searches:
+// move and score, depths and flags, the key XOR-ed with both, so an entry torn by two stores fails the key check
+struct TTSlot {
+  uint32_t check;
+  uint32_t moveScore;
+  uint32_t depthFlags;
+};
+
+// 12 byte entries with the 16 bit move, five of them fit one cache line
+constexpr size_t TT_BUCKET_SIZE = 5;
+
+// one bucket fills one cache line, so a probe costs a single cache miss
+struct alignas(64) TTBucket {
+  std::array<TTSlot, TT_BUCKET_SIZE> slots;
+};
+static_assert(sizeof(TTBucket) == 64, "transposition table bucket must fill one cache line");
+
+// shared by the search threads without locks
+class TranspositionTable {
+  public:
+  explicit TranspositionTable(size_t sizeMb = DEFAULT_TT_SIZE_MB);
+
+  // reallocates and clears the table, size is rounded down to a power of two buckets
+  void resize(size_t sizeMb);
+  void clear();
+  // ages entries of previous searches so they are replaced first
+  void newSearch();
+
+  bool probe(uint64_t key, TTEntry& entry) const;
+  void store(uint64_t key, Move bestMove, int16_t score, BoundType bound, uint8_t depth, uint8_t qsDepth, bool isQuietPosition);
+
+  // permille of sampled entries written by the current search
+  int32_t hashfull() const;
+  size_t getSizeBytes() const {
+    return buckets.size() * sizeof(TTBucket);
+  }
+
+  private:
+  inline TTBucket& getBucket(uint64_t key) {
+    return buckets[key & bucketMask];
+  }
+  inline const TTBucket& getBucket(uint64_t key) const {
+    return buckets[key & bucketMask];
+  }
+
+  std::vector<TTBucket> buckets;
+  uint64_t bucketMask{0};
+  uint8_t generation{0};
+};
+
+}
@@ -0,0 +1,99 @@
+#include "workpool.h"
+
+#include <algorithm>
+
+namespace chesseng {
+
+WorkStealingPool::WorkStealingPool(size_t workerCount) {
+  for(size_t i=0;i<std::max<size_t>(workerCount, 1);i++) {
+    queues.push_back(std::make_unique<WorkerQueue>());
+  }
+  for(size_t i=1;i<queues.size();i++) {
+    threads.emplace_back(&WorkStealingPool::workerLoop, this, i);
+  }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+  {
+    std::lock_guard<std::mutex> lock(wakeMutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for(auto& thread : threads) {
+    thread.join();
+  }
+}
+
+void WorkStealingPool::push(size_t worker, const void* tag, PoolTask task) {
+  {
+    std::lock_guard<std::mutex> lock(queues[worker]->mutex);
+    queues[worker]->tasks.emplace_back(tag, std::move(task));
+    queuedTasks++;
+  }
+  // a worker checks queuedTasks under wakeMutex before it sleeps, taking the mutex here means it cannot miss the notify
+  {
+    std::lock_guard<std::mutex> lock(wakeMutex);
+  }
+  wake.notify_one();
+}
+
+size_t WorkStealingPool::cancel(size_t worker, const void* tag) {
+  std::lock_guard<std::mutex> lock(queues[worker]->mutex);
+  auto& tasks = queues[worker]->tasks;
+  size_t before = tasks.size();
+  tasks.erase(std::remove_if(tasks.begin(), tasks.end(), [tag](const auto& task) { return task.first == tag; }), tasks.end());
+  size_t removed = before - tasks.size();
+  queuedTasks -= removed;
+  return removed;
+}
+
+bool WorkStealingPool::runOne(size_t worker, const TaskFilter& accept) {
+  auto accepted = [&accept](const auto& task) { return !accept || accept(task.first); };
+  PoolTask task;
+  bool stolen = false;
+  {
+    std::lock_guard<std::mutex> lock(queues[worker]->mutex);
+    auto& tasks = queues[worker]->tasks;
+    auto found = std::find_if(tasks.rbegin(), tasks.rend(), accepted);
+    if(found != tasks.rend()) {
+      task = std::move(found->second);
+      tasks.erase(std::next(found).base());
+    }
+  }
+  for(size_t i=1;!task && i<queues.size();i++) {
+    WorkerQueue& victim = *queues[(worker + i) % queues.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    auto found = std::find_if(victim.tasks.begin(), victim.tasks.end(), accepted);
+    if(found != victim.tasks.end()) {
+      task = std::move(found->second);
+      victim.tasks.erase(found);
+      stolen = true;
+    }
+  }
+  if(!task) {
+    return false;
+  }
+  queuedTasks--;
+  queues[worker]->tasksRun.fetch_add(1, std::memory_order_relaxed);
+  if(stolen) {
+    queues[worker]->steals.fetch_add(1, std::memory_order_relaxed);
+  }
+  task(worker);
+  return true;
+}
+
+void WorkStealingPool::workerLoop(size_t worker) {
+  while(!stopping) {
+    if(runOne(worker)) {
+      continue;
+    }
+    idleWorkers++;
+    {
+      std::unique_lock<std::mutex> lock(wakeMutex);
+      wake.wait(lock, [this]() { return stopping || queuedTasks > 0; });
+    }
+    idleWorkers--;
+  }
+}
+
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace chesseng {
+
+// runs on the worker that took it
+typedef std::function<void(size_t worker)> PoolTask;
+// picks the tasks a worker may run by their tag
+typedef std::function<bool(const void* tag)> TaskFilter;
+
+// one deque per worker: the owner pushes and pops at the back, idle workers steal from the front of the others.
+// Worker 0 is the thread that created the pool, it does not wait for tasks but runs them while it waits on its own.
+class WorkStealingPool {
+  public:
+  explicit WorkStealingPool(size_t workerCount);
+  ~WorkStealingPool();
+
+  inline size_t getWorkerCount() const {
+    return queues.size();
+  }
+  // more workers waiting than tasks queued
+  inline bool hasIdleWorkers() const {
+    return idleWorkers.load(std::memory_order_relaxed) > queuedTasks.load(std::memory_order_relaxed);
+  }
+  inline size_t getIdleWorkers() const {
+    size_t idle = idleWorkers.load(std::memory_order_relaxed);
+    size_t queued = queuedTasks.load(std::memory_order_relaxed);
+    return idle > queued ? idle - queued : 0;
+  }
+
+  // tag identifies the tasks of one owner for cancel
+  void push(size_t worker, const void* tag, PoolTask task);
+  // removes the worker's own tasks with the tag that nobody took yet, returns how many
+  size_t cancel(size_t worker, const void* tag);
+
+  // own newest task first, else the oldest task of another worker, only tasks the filter accepts if there is one;
+  // false if there was none. Also for a worker that waits on its own tasks to finish, so it helps instead of spinning
+  bool runOne(size_t worker, const TaskFilter& accept = TaskFilter());
+
+  // tasks run by the worker, taken from the deques of other workers
+  inline int64_t getTasksRun(size_t worker) const {
+    return queues[worker]->tasksRun.load(std::memory_order_relaxed);
+  }
+  inline int64_t getSteals(size_t worker) const {
+    return queues[worker]->steals.load(std::memory_order_relaxed);
+  }
+
+  private:
+  struct WorkerQueue {
+    std::mutex mutex;
+    std::deque<std::pair<const void*, PoolTask>> tasks;
+    std::atomic<int64_t> tasksRun{0};
+    std::atomic<int64_t> steals{0};
+  };
+
+  void workerLoop(size_t worker);
+
+  std::vector<std::unique_ptr<WorkerQueue>> queues;
+  std::vector<std::thread> threads;
+  std::atomic<size_t> queuedTasks{0};
+  std::atomic<size_t> idleWorkers{0};
+  std::atomic<bool> stopping{false};
+  std::mutex wakeMutex;
+  std::condition_variable wake;
+};
+
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace chesseng {
+
+// Zobrist keys, generated at compile time so the board hash is reproducible between runs
+struct ZobristKeys {
+  // indexed by square and square data (piece type and side)
+  std::array<std::array<uint64_t, 16>, 64> square{};
+  uint64_t blackToMove{0};
+  // indexed by castling rights
+  std::array<uint64_t, 16> castling{};
+  // indexed by en passant col + 1
+  std::array<uint64_t, 9> enPassant{};
+};
+
+constexpr uint64_t splitMix64(uint64_t& state) {
+  state += 0x9e3779b97f4a7c15ULL;
+  uint64_t z = state;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+constexpr ZobristKeys generateZobristKeys() {
+  ZobristKeys keys;
+  uint64_t state = 0x48656c6c6f456e67ULL;
+  for(size_t pos=0;pos<64;pos++) {
+    // empty square does not contribute to the hash
+    keys.square[pos][0] = 0;
+    for(size_t data=1;data<16;data++) {
+      keys.square[pos][data] = splitMix64(state);
+    }
+  }
+  keys.blackToMove = splitMix64(state);
+  // no castling rights and no en passant do not contribute to the hash
+  for(size_t castlingRights=1;castlingRights<16;castlingRights++) {
+    keys.castling[castlingRights] = splitMix64(state);
+  }
+  for(size_t enPassant=1;enPassant<9;enPassant++) {
+    keys.enPassant[enPassant] = splitMix64(state);
+  }
+  return keys;
+}
+
+inline constexpr ZobristKeys ZOBRIST = generateZobristKeys();
+
+}